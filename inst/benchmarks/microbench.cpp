@@ -0,0 +1,498 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+// Microbenchmarks of the C++ hot paths of Rosmium. Build from this directory
+// with
+//
+//   g++ -std=c++11 -O2 -I../include -I../../src -iquote ../../src/object_filter
+//       microbench.cpp ../../src/object_filter/*.cpp -o microbench
+//       -lz -lpthread -lexpat -lbz2
+//
+// The FlexLexer.h of the installed flex is needed; the copy in object_filter
+// does not match the generated scanner, hence -iquote instead of -I.
+//
+// and run
+//
+//   ./microbench [--nodes N] [--seed S] [--repeat R] [--dir DIR] [--keep]
+//
+// A synthetic file with N nodes (default 1000000) and the ways and
+// multipolygons built from them (see DataGenerator.hpp) is written to DIR
+// (default /tmp). Every
+// benchmark is run R times (default 3) and the fastest run is printed as one
+// CSV line (see printHeader()). The generated files are removed unless --keep
+// is given; benchmarks.R can be run on them.
+//
+// Benchmarks counting allocations (the area assembler per area) report the
+// calls of operator new in the main thread and the bytes requested.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <osmium/area/assembler.hpp>
+#include <osmium/builder/osm_object_builder.hpp>
+#include <osmium/handler.hpp>
+#include <osmium/handler/node_locations_for_ways.hpp>
+#include <osmium/index/map/compressed_mem_array.hpp>
+#include <osmium/index/map/dense_mem_array.hpp>
+#include <osmium/index/map/sparse_mem_array.hpp>
+#include <osmium/io/opl_output.hpp>
+#include <osmium/io/pbf_input.hpp>
+#include <osmium/io/pbf_output.hpp>
+#include <osmium/io/writer.hpp>
+#include <osmium/io/xml_input.hpp>
+#include <osmium/io/xml_output.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/visitor.hpp>
+
+#include "command.h"
+#include "interpreter.h"
+#include "AreaCollector.hpp"
+#include "DataGenerator.hpp"
+
+namespace microbench {
+
+// Allocations of the current thread, counted by the operator new below
+struct AllocationCount {
+  uint64_t allocations;
+  uint64_t bytes;
+};
+
+thread_local AllocationCount allocated = { 0, 0 };
+
+} // namespace microbench
+
+void* operator new(std::size_t size) {
+  ++microbench::allocated.allocations;
+  microbench::allocated.bytes += size;
+  void* ptr = std::malloc(size ? size : 1);
+  if(ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new[](std::size_t size) {
+  return ::operator new(size);
+}
+
+// not inlined, so the compiler doesn't pair free() with the new expressions
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  ::operator delete(ptr);
+}
+
+namespace microbench {
+
+typedef osmium::index::map::Map<osmium::unsigned_object_id_type, osmium::Location> index_type;
+
+struct Options {
+  size_t nodes = 1000000;
+  unsigned long seed = 42;
+  int repeat = 3;
+  std::string dir = "/tmp";
+  bool keep = false;
+};
+
+// Result of one run: the number of items processed, the bytes read,
+// written or allocated and the number of allocations (0 if not applicable)
+struct Run {
+  uint64_t items;
+  uint64_t bytes;
+  uint64_t allocations;
+
+  Run(uint64_t num_items = 0, uint64_t num_bytes = 0, uint64_t num_allocations = 0) :
+    items(num_items), bytes(num_bytes), allocations(num_allocations) {
+  }
+};
+
+// Results of the benchmarks are added here, so they can't be optimized away
+volatile uint64_t sink = 0;
+
+void printHeader() {
+  std::cout << "suite,benchmark,variant,items,bytes,seconds,items_per_second,allocations\n";
+}
+
+// Runs the benchmark repeat times and prints the fastest run
+template <typename TFunc>
+void measure(const Options& options, const std::string& suite, const std::string& benchmark, const std::string& variant, TFunc func) {
+  double best = std::numeric_limits<double>::max();
+  Run run;
+  for(int i = 0; i < options.repeat; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    run = func();
+    auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(end - start).count());
+  }
+  std::cout << suite << ',' << benchmark << ',' << variant << ',' << run.items << ',' << run.bytes << ','
+            << best << ',' << (best > 0 ? run.items / best : 0) << ',' << run.allocations << std::endl;
+}
+
+uint64_t fileSize(const std::string& filename) {
+  struct stat st;
+  return ::stat(filename.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+struct CountHandler : public osmium::handler::Handler {
+  uint64_t objects = 0;
+
+  void osm_object(const osmium::OSMObject&) {
+    ++objects;
+  }
+};
+
+Run writeFile(const std::vector<osmium::memory::Buffer>& buffers, const std::string& filename) {
+  std::remove(filename.c_str());
+  osmium::io::Writer writer(filename);
+  Run run;
+  for(const auto& buffer : buffers) {
+    for(auto it = buffer.cbegin<osmium::OSMObject>(); it != buffer.cend<osmium::OSMObject>(); ++it) {
+      ++run.items;
+    }
+    writer(osmium::memory::Buffer(const_cast<unsigned char*>(buffer.data()), buffer.committed()));
+  }
+  writer.close();
+  run.bytes = fileSize(filename);
+  return run;
+}
+
+Run readFile(const std::string& filename) {
+  osmium::io::Reader reader(filename);
+  CountHandler handler;
+  osmium::apply(reader, handler);
+  reader.close();
+  return Run { handler.objects, fileSize(filename) };
+}
+
+std::vector<osmium::memory::Buffer> readBuffers(const std::string& filename) {
+  std::vector<osmium::memory::Buffer> buffers;
+  osmium::io::Reader reader(filename);
+  while(osmium::memory::Buffer buffer = reader.read()) {
+    buffers.push_back(std::move(buffer));
+  }
+  reader.close();
+  return buffers;
+}
+
+std::shared_ptr<tagfilter::Command> parseFilter(const std::string& expr) {
+  tagfilter::Interpreter interpreter;
+  if(interpreter.parse(expr)) {
+    throw std::runtime_error("invalid filter expression '" + expr + "': " + interpreter.getError());
+  }
+  std::shared_ptr<tagfilter::Command> command = interpreter.returnAST();
+  tagfilter::simplifyCommand(command);
+  return command;
+}
+
+Run evaluateFilter(const std::vector<osmium::memory::Buffer>& buffers, const tagfilter::Command& command) {
+  // a fresh state, so bounding boxes don't see the ids of the previous run
+  tagfilter::FilterState state;
+  Run run;
+  uint64_t matches = 0;
+  for(const auto& buffer : buffers) {
+    for(auto it = buffer.cbegin<osmium::OSMObject>(); it != buffer.cend<osmium::OSMObject>(); ++it) {
+      ++run.items;
+      matches += command.execute(*it, state);
+    }
+  }
+  sink = sink + matches;
+  return run;
+}
+
+std::unique_ptr<index_type> createIndex(const std::string& name) {
+  if(name == "sparse_mem_array") {
+    return std::unique_ptr<index_type>(new osmium::index::map::SparseMemArray<osmium::unsigned_object_id_type, osmium::Location>());
+  } else if(name == "dense_mem_array") {
+    return std::unique_ptr<index_type>(new osmium::index::map::DenseMemArray<osmium::unsigned_object_id_type, osmium::Location>());
+  }
+  return std::unique_ptr<index_type>(new osmium::index::map::CompressedMemArray<osmium::unsigned_object_id_type, osmium::Location>());
+}
+
+void buildIndex(const std::vector<osmium::memory::Buffer>& buffers, index_type& index) {
+  for(const auto& buffer : buffers) {
+    for(auto it = buffer.cbegin<osmium::Node>(); it != buffer.cend<osmium::Node>(); ++it) {
+      index.set(static_cast<osmium::unsigned_object_id_type>(it->id()), it->location());
+    }
+  }
+  index.sort();
+}
+
+// Sums the coordinates of the way nodes, so the lookups can't be skipped
+struct WayLocationSum : public osmium::handler::Handler {
+  uint64_t refs = 0;
+  int64_t sum = 0;
+
+  void way(const osmium::Way& way) {
+    for(const auto& node_ref : way.nodes()) {
+      ++refs;
+      sum += node_ref.location().x() ^ node_ref.location().y();
+    }
+  }
+};
+
+struct AreaCount : public osmium::handler::Handler {
+  uint64_t areas = 0;
+
+  void area(const osmium::Area&) {
+    ++areas;
+  }
+};
+
+Run assembleAreas(const std::string& filename, const std::string& mode) {
+  osmium::area::Assembler::config_type config;
+  std::unique_ptr<index_type> index = createIndex("sparse_mem_array");
+  osmium::handler::NodeLocationsForWays<index_type> location_handler(*index);
+  location_handler.ignore_errors();
+  AreaCount count;
+  if(mode == "ways") {
+    ClosedWayAreaHandler<osmium::area::Assembler> handler(config, [&count](osmium::memory::Buffer&& buffer) {
+      osmium::apply(buffer, count);
+    });
+    osmium::io::Reader reader(filename);
+    osmium::apply(reader, location_handler, handler);
+    reader.close();
+  } else {
+    ParallelMultipolygonCollector<osmium::area::Assembler> collector(config, mode == "both");
+    osmium::io::Reader reader1(filename, osmium::osm_entity_bits::relation);
+    collector.read_relations(reader1);
+    reader1.close();
+    osmium::io::Reader reader2(filename);
+    osmium::apply(reader2, location_handler, collector.handler([&count](const osmium::memory::Buffer& buffer) {
+      osmium::apply(buffer, count);
+    }));
+    reader2.close();
+  }
+  return Run { count.areas, 0 };
+}
+
+// A multipolygon relation with its member ways (locations set in the way
+// nodes): an outer square of 4 tagged ways with inner_rings inner squares of
+// 2 untagged ways each
+struct Multipolygon {
+  osmium::memory::Buffer buffer { 1024 * 1024 };
+  std::vector<size_t> members;
+  size_t relation = 0;
+  osmium::object_id_type nextId = 1;
+
+  explicit Multipolygon(uint64_t inner_rings) {
+    const double size = 0.1;
+    const uint64_t columns = static_cast<uint64_t>(std::ceil(std::sqrt(static_cast<double>(inner_rings))));
+    const double cell = size / (columns + 1);
+    std::vector<osmium::object_id_type> ways = addSquare(8.0, 47.0, size, 4);
+    for(uint64_t i = 0; i < inner_rings; ++i) {
+      std::vector<osmium::object_id_type> inner = addSquare(8.0 + cell * (i % columns + 0.5), 47.0 + cell * (i / columns + 0.5), cell / 2, 2);
+      ways.insert(ways.end(), inner.begin(), inner.end());
+    }
+    relation = buffer.committed();
+    {
+      osmium::builder::RelationBuilder builder(buffer);
+      builder.object().set_id(1);
+      builder.add_user("bench");
+      {
+        osmium::builder::RelationMemberListBuilder list(buffer, &builder);
+        for(size_t i = 0; i < ways.size(); ++i) {
+          list.add_member(osmium::item_type::way, ways[i], i < 4 ? "outer" : "inner");
+        }
+      }
+      builder.add_tags({ { "type", "multipolygon" }, { "landuse", "forest" } });
+    }
+    buffer.commit();
+  }
+
+  // Adds the ways of a square split into parts ways, returns their ids
+  std::vector<osmium::object_id_type> addSquare(double lon, double lat, double side, int parts) {
+    const osmium::object_id_type first_node = nextId;
+    nextId += 4;
+    const osmium::Location corners[4] = {
+      osmium::Location(lon, lat), osmium::Location(lon + side, lat),
+      osmium::Location(lon + side, lat + side), osmium::Location(lon, lat + side)
+    };
+    std::vector<osmium::object_id_type> ids;
+    for(int part = 0; part < parts; ++part) {
+      ids.push_back(nextId++);
+      members.push_back(buffer.committed());
+      {
+        osmium::builder::WayBuilder builder(buffer);
+        builder.object().set_id(ids.back());
+        builder.add_user("bench");
+        {
+          osmium::builder::WayNodeListBuilder nodes(buffer, &builder);
+          for(int corner = part * 4 / parts; corner <= (part + 1) * 4 / parts; ++corner) {
+            nodes.add_node_ref(first_node + corner % 4, corners[corner % 4]);
+          }
+        }
+        if(parts == 4) {
+          builder.add_tags({ { "barrier", "fence" } });
+        }
+      }
+      buffer.commit();
+    }
+    return ids;
+  }
+};
+
+// One assembler reused for the given number of areas
+Run assembleMultipolygon(const Multipolygon& multipolygon, uint64_t areas) {
+  osmium::area::Assembler::config_type config;
+  osmium::memory::Buffer out(1024 * 1024);
+  const osmium::Relation& relation = multipolygon.buffer.get<osmium::Relation>(multipolygon.relation);
+  const AllocationCount before = allocated;
+  osmium::area::Assembler assembler(config);
+  Run run;
+  for(uint64_t i = 0; i < areas; ++i) {
+    assembler(relation, multipolygon.members, multipolygon.buffer, out);
+    for(auto it = out.cbegin<osmium::Area>(); it != out.cend<osmium::Area>(); ++it) {
+      ++run.items;
+    }
+    out.clear();
+  }
+  run.allocations = allocated.allocations - before.allocations;
+  run.bytes = allocated.bytes - before.bytes;
+  return run;
+}
+
+Options parseOptions(int argc, char* argv[]) {
+  Options options;
+  for(int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if(arg == "--keep") {
+      options.keep = true;
+    } else if(i + 1 < argc && arg == "--nodes") {
+      options.nodes = std::strtoull(argv[++i], nullptr, 10);
+    } else if(i + 1 < argc && arg == "--seed") {
+      options.seed = std::strtoul(argv[++i], nullptr, 10);
+    } else if(i + 1 < argc && arg == "--repeat") {
+      options.repeat = std::max(1, std::atoi(argv[++i]));
+    } else if(i + 1 < argc && arg == "--dir") {
+      options.dir = argv[++i];
+    } else {
+      throw std::invalid_argument("usage: microbench [--nodes N] [--seed S] [--repeat R] [--dir DIR] [--keep]");
+    }
+  }
+  return options;
+}
+
+} // namespace microbench
+
+int main(int argc, char* argv[]) {
+  using namespace microbench;
+  try {
+    Options options = parseOptions(argc, argv);
+    const std::string pbf_file = options.dir + "/rosmium_bench.osm.pbf";
+    const std::string xml_file = options.dir + "/rosmium_bench.osm";
+    const std::string opl_file = options.dir + "/rosmium_bench.osm.opl";
+
+    printHeader();
+    datagenerator::Config config;
+    config.nodes = options.nodes;
+    config.ways = options.nodes / 10;
+    config.relations = options.nodes / 1000;
+    config.seed = options.seed;
+    std::vector<osmium::memory::Buffer> generated;
+    DataGenerator(config).generate([&generated](osmium::memory::Buffer&& buffer) {
+      generated.push_back(std::move(buffer));
+    });
+
+    measure(options, "io", "write", "pbf", [&] { return writeFile(generated, pbf_file); });
+    measure(options, "io", "write", "xml", [&] { return writeFile(generated, xml_file); });
+    measure(options, "io", "write", "opl", [&] { return writeFile(generated, opl_file); });
+    generated.clear();
+    std::remove(opl_file.c_str());
+
+    measure(options, "io", "read", "pbf", [&] { return readFile(pbf_file); });
+    measure(options, "io", "read", "xml", [&] { return readFile(xml_file); });
+
+    std::vector<osmium::memory::Buffer> buffers = readBuffers(pbf_file);
+    const char* filters[][2] = {
+      { "key", "k == \"highway\"" },
+      { "value", "v == \"residential\"" },
+      { "tag", "t(\"highway\", \"residential\")" },
+      { "key_contains", "k %contains% \"ame\"" },
+      { "value_grepl", "v %grepl% \"^res.*al$\"" },
+      { "id", "id(\"4711\", EntityBits.node)" },
+      { "distance", "haversineDistance(8.01, 47.01) < 500" },
+      { "bounding_box", "bb(8.0, 47.0, 8.02, 47.02)" },
+      { "and_or_not", "(k == \"highway\" & !v == \"footway\") | k == \"amenity\"" }
+    };
+    for(const auto& filter : filters) {
+      std::shared_ptr<tagfilter::Command> command = parseFilter(filter[1]);
+      measure(options, "filter", "evaluate", filter[0], [&] { return evaluateFilter(buffers, *command); });
+    }
+
+    for(const char* name : { "sparse_mem_array", "dense_mem_array", "compressed_mem_array" }) {
+      std::unique_ptr<index_type> index;
+      measure(options, "location_index", "build", name, [&] {
+        index = createIndex(name);
+        buildIndex(buffers, *index);
+        return Run { index->size(), index->used_memory() };
+      });
+      measure(options, "location_index", "lookup", name, [&] {
+        osmium::handler::NodeLocationsForWays<index_type> location_handler(*index);
+        location_handler.ignore_errors();
+        WayLocationSum sum;
+        for(auto& buffer : buffers) {
+          if(buffer.begin<osmium::OSMObject>() != buffer.end<osmium::OSMObject>() &&
+             buffer.begin<osmium::OSMObject>()->type() != osmium::item_type::node) {
+            osmium::apply(buffer, location_handler, sum);
+          }
+        }
+        sink = sink + static_cast<uint64_t>(sum.sum);
+        return Run { sum.refs, 0 };
+      });
+    }
+    buffers.clear();
+
+    for(const char* mode : { "both", "relations", "ways" }) {
+      measure(options, "area", "assemble", mode, [&] { return assembleAreas(pbf_file, mode); });
+    }
+
+    for(uint64_t inner_rings : { 1, 20, 100 }) {
+      Multipolygon multipolygon(inner_rings);
+      const uint64_t areas = std::max<uint64_t>(100, 20000 / (inner_rings + 1));
+      measure(options, "area", "assembler", "inner_" + std::to_string(inner_rings), [&] {
+        return assembleMultipolygon(multipolygon, areas);
+      });
+    }
+
+    if(!options.keep) {
+      std::remove(pbf_file.c_str());
+      std::remove(xml_file.c_str());
+    }
+  } catch(const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
@@ -38,15 +38,14 @@ DEALINGS IN THE SOFTWARE.
 #include <cstring>
 #include <iostream>
 #include <iterator>
-#include <list>
-#include <set>
-#include <string>
-#include <map>
+#include <deque>
+#include <utility>
 #include <vector>
 
 #include <osmium/builder/osm_object_builder.hpp>
 #include <osmium/memory/buffer.hpp>
 #include <osmium/osm/area.hpp>
+#include <osmium/osm/box.hpp>
 #include <osmium/osm/location.hpp>
 #include <osmium/osm/relation.hpp>
 #include <osmium/tags/filter.hpp>
@@ -88,6 +87,10 @@ namespace osmium {
          * Assembles area objects from multipolygon relations and their
          * members. This is called by the MultipolygonCollector object
          * after all members have been collected.
+         *
+         * An Assembler can be used for any number of areas. The memory
+         * used for building the rings is kept and reused for the next
+         * area.
          */
         class Assembler {
 
@@ -96,18 +99,98 @@ namespace osmium {
             // The way segments
             osmium::area::detail::SegmentList m_segment_list;
 
-            // The rings we are building from the way segments
-            std::list<ProtoRing> m_rings;
+            // Storage for the rings. The first m_num_rings rings have been
+            // used for the current area, all rings (and their memory) are
+            // reused for the next area. A deque is used, because adding rings
+            // must not invalidate references to existing rings.
+            std::deque<ProtoRing> m_ring_storage;
+            size_t m_num_rings { 0 };
+
+            // The rings we are building from the way segments in the order
+            // they were created. Rings merged into other rings are emptied
+            // and removed after all segments have been added.
+            std::vector<ProtoRing*> m_rings;
+
+            // The rings which can still be extended, in the same order as in
+            // m_rings. Closed rings are never extended again and are dropped
+            // from this list, so the rings don't have to be compared with
+            // all rings built so far.
+            std::vector<ProtoRing*> m_open_rings;
 
             std::vector<ProtoRing*> m_outer_rings;
             std::vector<ProtoRing*> m_inner_rings;
 
             int m_inner_outer_mismatches { 0 };
 
+            // Scratch space reused between areas
+            struct ring_segment_type {
+                osmium::Location first;
+                osmium::Location second;
+                size_t ring;
+
+                bool operator<(const ring_segment_type& other) const noexcept {
+                    return first < other.first || (first == other.first && second < other.second);
+                }
+            };
+            std::vector<ring_segment_type> m_ring_segments;
+            std::vector<size_t> m_segment_ring;
+            std::vector<size_t> m_segment_order;
+            std::vector<size_t> m_active_segments;
+            std::vector<std::pair<osmium::Location, size_t>> m_ring_min_nodes;
+            std::vector<std::pair<int64_t, ProtoRing*>> m_outer_areas;
+            std::vector<osmium::Box> m_outer_boxes;
+            std::vector<const osmium::Way*> m_ways;
+            std::vector<std::pair<const char*, const char*>> m_tags;
+            osmium::area::detail::ProtoRing::segments_type m_sorted_segments;
+
             bool debug() const {
                 return m_config.debug;
             }
 
+            static int32_t min_y(const osmium::area::detail::NodeRefSegment& segment) noexcept {
+                return std::min(segment.first().location().y(), segment.second().location().y());
+            }
+
+            static int32_t max_y(const osmium::area::detail::NodeRefSegment& segment) noexcept {
+                return std::max(segment.first().location().y(), segment.second().location().y());
+            }
+
+            /**
+             * Reset the assembler for the next area without freeing any
+             * memory.
+             */
+            void clear() {
+                m_segment_list.clear();
+                m_num_rings = 0;
+                m_rings.clear();
+                m_open_rings.clear();
+                m_outer_rings.clear();
+                m_inner_rings.clear();
+                m_inner_outer_mismatches = 0;
+            }
+
+            /**
+             * Add a new (uninitialized) ring, reusing the memory of an old
+             * one if possible.
+             */
+            ProtoRing& add_ring() {
+                if (m_num_rings == m_ring_storage.size()) {
+                    m_ring_storage.emplace_back();
+                }
+                ProtoRing& ring = m_ring_storage[m_num_rings++];
+                m_rings.push_back(&ring);
+                m_open_rings.push_back(&ring);
+                return ring;
+            }
+
+            /**
+             * Remove a ring merged into another ring.
+             */
+            void remove_ring(std::vector<ProtoRing*>::iterator it) {
+                (*it)->segments().clear();
+                m_open_rings.erase(it);
+            }
+
             /**
              * Checks whether the given NodeRefs have the same location.
              * Uses the actual location for the test, not the id. If both
@@ -133,26 +216,41 @@ namespace osmium {
                 }
             }
 
-            void add_common_tags(osmium::builder::TagListBuilder& tl_builder, std::set<const osmium::Way*>& ways) const {
-                std::map<std::string, size_t> counter;
-                for (const osmium::Way* way : ways) {
+            /**
+             * Add the tags common to all ways in m_ways (which must be
+             * sorted and unique). The tags are counted in a sorted flat
+             * vector pointing into the ways instead of a map of strings.
+             */
+            void add_common_tags(osmium::builder::TagListBuilder& tl_builder) {
+                m_tags.clear();
+                for (const osmium::Way* way : m_ways) {
                     for (const auto& tag : way->tags()) {
-                        std::string kv {tag.key()};
-                        kv.append(1, '\0');
-                        kv.append(tag.value());
-                        ++counter[kv];
+                        m_tags.emplace_back(tag.key(), tag.value());
                     }
                 }
 
-                size_t num_ways = ways.size();
-                for (const auto& t_c : counter) {
+                const auto tag_equal = [](const std::pair<const char*, const char*>& a, const std::pair<const char*, const char*>& b) {
+                    return !std::strcmp(a.first, b.first) && !std::strcmp(a.second, b.second);
+                };
+                std::sort(m_tags.begin(), m_tags.end(), [](const std::pair<const char*, const char*>& a, const std::pair<const char*, const char*>& b) {
+                    const int c = std::strcmp(a.first, b.first);
+                    return c < 0 || (c == 0 && std::strcmp(a.second, b.second) < 0);
+                });
+
+                const size_t num_ways = m_ways.size();
+                for (auto it = m_tags.begin(); it != m_tags.end(); ) {
+                    auto next = it + 1;
+                    while (next != m_tags.end() && tag_equal(*it, *next)) {
+                        ++next;
+                    }
+                    const size_t count = static_cast<size_t>(std::distance(it, next));
                     if (debug()) {
-                        std::cerr << "        tag " << t_c.first << " is used " << t_c.second << " times in " << num_ways << " ways\n";
+                        std::cerr << "        tag " << it->first << "=" << it->second << " is used " << count << " times in " << num_ways << " ways\n";
                     }
-                    if (t_c.second == num_ways) {
-                        size_t len = std::strlen(t_c.first.c_str());
-                        tl_builder.add_tag(t_c.first.c_str(), t_c.first.c_str() + len + 1);
+                    if (count == num_ways) {
+                        tl_builder.add_tag(it->first, it->second);
                     }
+                    it = next;
                 }
             }
 
@@ -174,7 +272,7 @@ namespace osmium {
                 return filter;
             }
 
-            void add_tags_to_area(osmium::builder::AreaBuilder& builder, const osmium::Relation& relation) const {
+            void add_tags_to_area(osmium::builder::AreaBuilder& builder, const osmium::Relation& relation) {
                 const auto count = std::count_if(relation.tags().begin(), relation.tags().end(), filter());
 
                 if (debug()) {
@@ -197,16 +295,18 @@ namespace osmium {
                     if (debug()) {
                         std::cerr << "    use tags from outer ways\n";
                     }
-                    std::set<const osmium::Way*> ways;
+                    m_ways.clear();
                     for (const auto& ring : m_outer_rings) {
-                        ring->get_ways(ways);
+                        ring->get_ways(m_ways);
                     }
-                    if (ways.size() == 1) {
+                    std::sort(m_ways.begin(), m_ways.end());
+                    m_ways.erase(std::unique(m_ways.begin(), m_ways.end()), m_ways.end());
+                    if (m_ways.size() == 1) {
                         if (debug()) {
                             std::cerr << "      only one outer way\n";
                         }
                         osmium::builder::TagListBuilder tl_builder(builder.buffer(), &builder);
-                        for (const osmium::Tag& tag : (*ways.begin())->tags()) {
+                        for (const osmium::Tag& tag : m_ways.front()->tags()) {
                             tl_builder.add_tag(tag.key(), tag.value());
                         }
                     } else {
@@ -214,7 +314,7 @@ namespace osmium {
                             std::cerr << "      multiple outer ways, get common tags\n";
                         }
                         osmium::builder::TagListBuilder tl_builder(builder.buffer(), &builder);
-                        add_common_tags(tl_builder, ways);
+                        add_common_tags(tl_builder);
                     }
                 }
             }
@@ -228,7 +328,8 @@ namespace osmium {
             bool check_for_open_rings() {
                 bool open_rings = false;
 
-                for (const auto& ring : m_rings) {
+                for (const ProtoRing* ringptr : m_rings) {
+                    const ProtoRing& ring = *ringptr;
                     if (!ring.closed()) {
                         open_rings = true;
                         if (m_config.problem_reporter) {
@@ -253,22 +354,23 @@ namespace osmium {
                 if (debug()) {
                     std::cerr << "      possibly_combine_rings_back()\n";
                 }
-                for (auto it = m_rings.begin(); it != m_rings.end(); ++it) {
-                    if (&*it != &ring && !it->closed()) {
-                        if (has_same_location(nr, it->get_segment_front().first())) {
+                for (auto it = m_open_rings.begin(); it != m_open_rings.end(); ++it) {
+                    ProtoRing& other = **it;
+                    if (&other != &ring && !other.closed()) {
+                        if (has_same_location(nr, other.get_segment_front().first())) {
                             if (debug()) {
                                 std::cerr << "      ring.last=it->first\n";
                             }
-                            ring.merge_ring(*it, debug());
-                            m_rings.erase(it);
+                            ring.merge_ring(other, debug());
+                            remove_ring(it);
                             return true;
                         }
-                        if (has_same_location(nr, it->get_segment_back().second())) {
+                        if (has_same_location(nr, other.get_segment_back().second())) {
                             if (debug()) {
                                 std::cerr << "      ring.last=it->last\n";
                             }
-                            ring.merge_ring_reverse(*it, debug());
-                            m_rings.erase(it);
+                            ring.merge_ring_reverse(other, debug());
+                            remove_ring(it);
                             return true;
                         }
                     }
@@ -289,24 +391,25 @@ namespace osmium {
                 if (debug()) {
                     std::cerr << "      possibly_combine_rings_front()\n";
                 }
-                for (auto it = m_rings.begin(); it != m_rings.end(); ++it) {
-                    if (&*it != &ring && !it->closed()) {
-                        if (has_same_location(nr, it->get_segment_back().second())) {
+                for (auto it = m_open_rings.begin(); it != m_open_rings.end(); ++it) {
+                    ProtoRing& other = **it;
+                    if (&other != &ring && !other.closed()) {
+                        if (has_same_location(nr, other.get_segment_back().second())) {
                             if (debug()) {
                                 std::cerr << "      ring.first=it->last\n";
                             }
-                            ring.swap_segments(*it);
-                            ring.merge_ring(*it, debug());
-                            m_rings.erase(it);
+                            ring.swap_segments(other);
+                            ring.merge_ring(other, debug());
+                            remove_ring(it);
                             return true;
                         }
-                        if (has_same_location(nr, it->get_segment_front().first())) {
+                        if (has_same_location(nr, other.get_segment_front().first())) {
                             if (debug()) {
                                 std::cerr << "      ring.first=it->first\n";
                             }
                             ring.reverse();
-                            ring.merge_ring(*it, debug());
-                            m_rings.erase(it);
+                            ring.merge_ring(other, debug());
+                            remove_ring(it);
                             return true;
                         }
                     }
@@ -318,14 +421,14 @@ namespace osmium {
                 if (debug()) {
                     std::cerr << "        subring found at: " << *it << "\n";
                 }
-                ProtoRing new_ring(it_begin, it_end);
+                ProtoRing& new_ring = add_ring();
+                new_ring.reset(it_begin, it_end);
                 ring.remove_segments(it_begin, it_end);
                 if (debug()) {
                     std::cerr << "        split into two rings:\n";
                     std::cerr << "          " << new_ring << "\n";
                     std::cerr << "          " << ring << "\n";
                 }
-                m_rings.push_back(std::move(new_ring));
             }
 
             bool has_closed_subring_back(ProtoRing& ring, const NodeRef& nr) {
@@ -367,13 +470,12 @@ namespace osmium {
                     std::cerr << "      check_for_closed_subring()\n";
                 }
 
-                osmium::area::detail::ProtoRing::segments_type segments(ring.segments().size());
-                std::copy(ring.segments().begin(), ring.segments().end(), segments.begin());
-                std::sort(segments.begin(), segments.end());
-                const auto it = std::adjacent_find(segments.begin(), segments.end(), [this](const osmium::area::detail::NodeRefSegment& s1, const osmium::area::detail::NodeRefSegment& s2) {
+                m_sorted_segments.assign(ring.segments().begin(), ring.segments().end());
+                std::sort(m_sorted_segments.begin(), m_sorted_segments.end());
+                const auto it = std::adjacent_find(m_sorted_segments.begin(), m_sorted_segments.end(), [this](const osmium::area::detail::NodeRefSegment& s1, const osmium::area::detail::NodeRefSegment& s2) {
                     return has_same_location(s1.first(), s2.first());
                 });
-                if (it == segments.end()) {
+                if (it == m_sorted_segments.end()) {
                     return false;
                 }
                 const auto r1 = std::find_first_of(ring.segments().begin(), ring.segments().end(), it, it+1);
@@ -387,7 +489,8 @@ namespace osmium {
 
                 const auto m = std::minmax(r1, r2);
 
-                ProtoRing new_ring(m.first, m.second);
+                ProtoRing& new_ring = add_ring();
+                new_ring.reset(m.first, m.second);
                 ring.remove_segments(m.first, m.second);
 
                 if (debug()) {
@@ -395,8 +498,6 @@ namespace osmium {
                     std::cerr << "        split ring2=" << ring << "\n";
                 }
 
-                m_rings.emplace_back(new_ring);
-
                 return true;
             }
 
@@ -449,37 +550,36 @@ namespace osmium {
             }
 
             bool add_to_existing_ring(osmium::area::detail::NodeRefSegment segment) {
+                m_open_rings.erase(std::remove_if(m_open_rings.begin(), m_open_rings.end(), [](const ProtoRing* ring) {
+                    return ring->closed();
+                }), m_open_rings.end());
+
                 int n = 0;
-                for (auto& ring : m_rings) {
+                for (ProtoRing* ringptr : m_open_rings) {
+                    ProtoRing& ring = *ringptr;
                     if (debug()) {
                         std::cerr << "    check against ring " << n << " " << ring;
                     }
-                    if (ring.closed()) {
-                        if (debug()) {
-                            std::cerr << " => ring CLOSED\n";
-                        }
-                    } else {
-                        if (has_same_location(ring.get_segment_back().second(), segment.first())) {
-                            combine_rings_back(segment, ring);
-                            return true;
-                        }
-                        if (has_same_location(ring.get_segment_back().second(), segment.second())) {
-                            segment.swap_locations();
-                            combine_rings_back(segment, ring);
-                            return true;
-                        }
-                        if (has_same_location(ring.get_segment_front().first(), segment.first())) {
-                            segment.swap_locations();
-                            combine_rings_front(segment, ring);
-                            return true;
-                        }
-                        if (has_same_location(ring.get_segment_front().first(), segment.second())) {
-                            combine_rings_front(segment, ring);
-                            return true;
-                        }
-                        if (debug()) {
-                            std::cerr << " => no match\n";
-                        }
+                    if (has_same_location(ring.get_segment_back().second(), segment.first())) {
+                        combine_rings_back(segment, ring);
+                        return true;
+                    }
+                    if (has_same_location(ring.get_segment_back().second(), segment.second())) {
+                        segment.swap_locations();
+                        combine_rings_back(segment, ring);
+                        return true;
+                    }
+                    if (has_same_location(ring.get_segment_front().first(), segment.first())) {
+                        segment.swap_locations();
+                        combine_rings_front(segment, ring);
+                        return true;
+                    }
+                    if (has_same_location(ring.get_segment_front().first(), segment.second())) {
+                        combine_rings_front(segment, ring);
+                        return true;
+                    }
+                    if (debug()) {
+                        std::cerr << " => no match\n";
                     }
 
                     ++n;
@@ -487,51 +587,107 @@ namespace osmium {
                 return false;
             }
 
-            void check_inner_outer(ProtoRing& ring) {
-                const osmium::NodeRef& min_node = ring.min_node();
-                if (debug()) {
-                    std::cerr << "    check_inner_outer min_node=" << min_node << "\n";
+            /**
+             * Find out which rings are inner rings. For every ring the
+             * segments not belonging to the ring are counted that cross a
+             * horizontal ray from the lowest/leftmost node of the ring to
+             * the left. An odd number of crossings means that the ring is
+             * inside another ring.
+             *
+             * Instead of testing all segments for every ring, the rings are
+             * processed in the order of the y coordinate of their min node
+             * while sweeping over the segments sorted by their y range.
+             * Only the segments whose y range contains the current y
+             * coordinate are tested.
+             */
+            void find_inner_rings() {
+                const size_t num_segments = m_segment_list.size();
+
+                // find the ring of every segment
+                m_ring_segments.clear();
+                for (size_t r = 0; r < m_rings.size(); ++r) {
+                    for (const auto& segment : m_rings[r]->segments()) {
+                        osmium::Location a = segment.first().location();
+                        osmium::Location b = segment.second().location();
+                        if (b < a) {
+                            std::swap(a, b);
+                        }
+                        m_ring_segments.push_back(ring_segment_type{a, b, r});
+                    }
+                }
+                std::sort(m_ring_segments.begin(), m_ring_segments.end());
+                m_segment_ring.resize(num_segments);
+                for (size_t i = 0; i < num_segments; ++i) {
+                    const ring_segment_type key{m_segment_list[i].first().location(), m_segment_list[i].second().location(), 0};
+                    const auto it = std::lower_bound(m_ring_segments.begin(), m_ring_segments.end(), key);
+                    const bool found = it != m_ring_segments.end() && it->first == key.first && it->second == key.second;
+                    m_segment_ring[i] = found ? it->ring : m_rings.size();
                 }
 
-                int count = 0;
-                int above = 0;
+                // segments sorted by their lowest y coordinate
+                m_segment_order.resize(num_segments);
+                for (size_t i = 0; i < num_segments; ++i) {
+                    m_segment_order[i] = i;
+                }
+                std::sort(m_segment_order.begin(), m_segment_order.end(), [this](size_t a, size_t b) {
+                    return min_y(m_segment_list[a]) < min_y(m_segment_list[b]);
+                });
 
-                for (auto it = m_segment_list.begin(); it != m_segment_list.end() && it->first().location().x() <= min_node.location().x(); ++it) {
-                    if (!ring.contains(*it)) {
-                        if (debug()) {
-                            std::cerr << "      segments for count: " << *it;
+                // rings sorted by the y coordinate of their min node
+                m_ring_min_nodes.clear();
+                for (size_t r = 0; r < m_rings.size(); ++r) {
+                    m_ring_min_nodes.emplace_back(m_rings[r]->min_node().location(), r);
+                }
+                std::sort(m_ring_min_nodes.begin(), m_ring_min_nodes.end(), [](const std::pair<osmium::Location, size_t>& a, const std::pair<osmium::Location, size_t>& b) {
+                    return a.first.y() < b.first.y();
+                });
+
+                m_active_segments.clear();
+                size_t next_segment = 0;
+                for (const auto& ring_min_node : m_ring_min_nodes) {
+                    const osmium::Location location = ring_min_node.first;
+                    ProtoRing& ring = *m_rings[ring_min_node.second];
+
+                    while (next_segment < num_segments && min_y(m_segment_list[m_segment_order[next_segment]]) <= location.y()) {
+                        m_active_segments.push_back(m_segment_order[next_segment]);
+                        ++next_segment;
+                    }
+                    m_active_segments.erase(std::remove_if(m_active_segments.begin(), m_active_segments.end(), [this, &location](size_t i) {
+                        return max_y(m_segment_list[i]) < location.y();
+                    }), m_active_segments.end());
+
+                    if (debug()) {
+                        std::cerr << "    find_inner_rings min_node=" << location << " active segments=" << m_active_segments.size() << "\n";
+                    }
+
+                    int count = 0;
+                    int above = 0;
+
+                    for (size_t i : m_active_segments) {
+                        const osmium::area::detail::NodeRefSegment& segment = m_segment_list[i];
+                        if (m_segment_ring[i] == ring_min_node.second || segment.first().location().x() > location.x()) {
+                            continue;
                         }
-                        if (it->to_left_of(min_node.location())) {
+                        if (segment.to_left_of(location)) {
                             ++count;
-                            if (debug()) {
-                                std::cerr << " counted\n";
-                            }
-                        } else {
-                            if (debug()) {
-                                std::cerr << " not counted\n";
-                            }
                         }
-                        if (it->first().location() == min_node.location()) {
-                            if (it->second().location().y() > min_node.location().y()) {
-                                ++above;
-                            }
+                        if (segment.first().location() == location && segment.second().location().y() > location.y()) {
+                            ++above;
                         }
-                        if (it->second().location() == min_node.location()) {
-                            if (it->first().location().y() > min_node.location().y()) {
-                                ++above;
-                            }
+                        if (segment.second().location() == location && segment.first().location().y() > location.y()) {
+                            ++above;
                         }
                     }
-                }
 
-                if (debug()) {
-                    std::cerr << "      count=" << count << " above=" << above << "\n";
-                }
+                    if (debug()) {
+                        std::cerr << "      count=" << count << " above=" << above << "\n";
+                    }
 
-                count += above % 2;
+                    count += above % 2;
 
-                if (count % 2) {
-                    ring.set_inner();
+                    if (count % 2) {
+                        ring.set_inner();
+                    }
                 }
             }
 
@@ -594,13 +750,18 @@ namespace osmium {
                         if (debug()) {
                             std::cerr << "    new ring for segment " << segment << "\n";
                         }
-                        m_rings.emplace_back(segment);
+                        add_ring().reset(segment);
                     }
                 }
 
+                m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [](const ProtoRing* ring) {
+                    return ring->segments().empty();
+                }), m_rings.end());
+
                 if (debug()) {
                     std::cerr << "  Rings:\n";
-                    for (const auto& ring : m_rings) {
+                    for (const ProtoRing* ringptr : m_rings) {
+                        const ProtoRing& ring = *ringptr;
                         std::cerr << "    " << ring;
                         if (ring.closed()) {
                             std::cerr << " (closed)";
@@ -621,10 +782,11 @@ namespace osmium {
                 }
 
                 if (m_rings.size() == 1) {
-                    m_outer_rings.push_back(&m_rings.front());
+                    m_outer_rings.push_back(m_rings.front());
                 } else {
-                    for (auto& ring : m_rings) {
-                        check_inner_outer(ring);
+                    find_inner_rings();
+                    for (ProtoRing* ringptr : m_rings) {
+                        ProtoRing& ring = *ringptr;
                         if (ring.outer()) {
                             if (!ring.is_cw()) {
                                 ring.reverse();
@@ -644,13 +806,25 @@ namespace osmium {
                         }
                     } else {
                         // sort outer rings by size, smallest first
-                        std::sort(m_outer_rings.begin(), m_outer_rings.end(), [](ProtoRing* a, ProtoRing* b) {
-                            return a->area() < b->area();
+                        m_outer_areas.clear();
+                        for (ProtoRing* outer : m_outer_rings) {
+                            m_outer_areas.emplace_back(outer->area(), outer);
+                        }
+                        std::sort(m_outer_areas.begin(), m_outer_areas.end(), [](const std::pair<int64_t, ProtoRing*>& a, const std::pair<int64_t, ProtoRing*>& b) {
+                            return a.first < b.first;
                         });
+                        m_outer_boxes.clear();
+                        for (size_t i = 0; i < m_outer_areas.size(); ++i) {
+                            m_outer_rings[i] = m_outer_areas[i].second;
+                            m_outer_boxes.push_back(m_outer_rings[i]->box());
+                        }
+                        // the bounding boxes rule out most outer rings
+                        // before the (expensive) point in polygon test
                         for (auto inner : m_inner_rings) {
-                            for (auto outer : m_outer_rings) {
-                                if (inner->is_in(outer)) {
-                                    outer->add_inner_ring(inner);
+                            const osmium::Location testpoint = inner->segments().front().first().location();
+                            for (size_t i = 0; i < m_outer_rings.size(); ++i) {
+                                if (m_outer_boxes[i].contains(testpoint) && inner->is_in(m_outer_rings[i])) {
+                                    m_outer_rings[i]->add_inner_ring(inner);
                                     break;
                                 }
                             }
@@ -679,6 +853,8 @@ namespace osmium {
              * The resulting area is put into the out_buffer.
              */
             void operator()(const osmium::Way& way, osmium::memory::Buffer& out_buffer) {
+                clear();
+
                 if (m_config.problem_reporter) {
                     m_config.problem_reporter->set_object(osmium::item_type::way, way.id());
                 }
@@ -716,6 +892,8 @@ namespace osmium {
              * The resulting area is put into the out_buffer.
              */
             void operator()(const osmium::Relation& relation, const std::vector<size_t>& members, const osmium::memory::Buffer& in_buffer, osmium::memory::Buffer& out_buffer) {
+                clear();
+
                 if (m_config.problem_reporter) {
                     m_config.problem_reporter->set_object(osmium::item_type::relation, relation.id());
                 }
@@ -771,10 +949,11 @@ namespace osmium {
                     }
                 }
 
-                // Now build areas for all ways found in the last step.
+                // Now build areas for all ways found in the last step. The
+                // state of this assembler is not needed any more and is
+                // reused.
                 for (const osmium::Way* way : ways_that_should_be_areas) {
-                    Assembler assembler(m_config);
-                    assembler(*way, out_buffer);
+                    (*this)(*way, out_buffer);
                 }
             }
 
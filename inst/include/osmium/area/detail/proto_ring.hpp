@@ -41,6 +41,7 @@ DEALINGS IN THE SOFTWARE.
 #include <set>
 #include <vector>
 
+#include <osmium/osm/box.hpp>
 #include <osmium/osm/location.hpp>
 #include <osmium/osm/node_ref.hpp>
 #include <osmium/area/detail/node_ref_segment.hpp>
@@ -72,6 +73,8 @@ namespace osmium {
 
             public:
 
+                ProtoRing() = default;
+
                 explicit ProtoRing(const NodeRefSegment& segment) noexcept :
                     m_segments() {
                     add_segment_back(segment);
@@ -82,6 +85,24 @@ namespace osmium {
                     std::copy(sbegin, send, m_segments.begin());
                 }
 
+                /**
+                 * Reinitialize this ring with the given segments. The
+                 * allocated memory is reused.
+                 */
+                void reset(segments_type::const_iterator sbegin, segments_type::const_iterator send) {
+                    m_segments.assign(sbegin, send);
+                    m_outer = true;
+                    m_inner.clear();
+                }
+
+                void reset(const NodeRefSegment& segment) {
+                    m_segments.clear();
+                    m_segments.push_back(segment);
+                    m_outer = true;
+                    m_inner.clear();
+                }
+
+
                 bool outer() const noexcept {
                     return m_outer;
                 }
@@ -231,6 +252,14 @@ namespace osmium {
                     }
                 }
 
+                osmium::Box box() const {
+                    osmium::Box box;
+                    for (const auto& segment : m_segments) {
+                        box.extend(segment.first().location());
+                    }
+                    return box;
+                }
+
                 bool is_in(ProtoRing* outer) {
                     osmium::Location testpoint = segments().front().first().location();
                     bool is_in = false;
@@ -245,9 +274,13 @@ namespace osmium {
                     return is_in;
                 }
 
-                void get_ways(std::set<const osmium::Way*>& ways) {
+                /**
+                 * Add the ways of all segments to the vector. The vector
+                 * may contain duplicates afterwards.
+                 */
+                void get_ways(std::vector<const osmium::Way*>& ways) const {
                     for (const auto& segment : m_segments) {
-                        ways.insert(segment.way());
+                        ways.push_back(segment.way());
                     }
                 }
 
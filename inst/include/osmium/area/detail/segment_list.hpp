@@ -87,6 +87,10 @@ namespace osmium {
                     return m_segments.empty();
                 }
 
+                const NodeRefSegment& operator[](size_t n) const noexcept {
+                    return m_segments[n];
+                }
+
                 typedef slist_type::const_iterator const_iterator;
 
                 const_iterator begin() const noexcept {
@@ -34,6 +34,7 @@ DEALINGS IN THE SOFTWARE.
 */
 
 #include <type_traits>
+#include <vector>
 
 #include <osmium/handler.hpp>
 #include <osmium/index/index.hpp>
@@ -84,6 +85,10 @@ namespace osmium {
 
             bool m_must_sort {false};
 
+            // Scratch space for looking up all node locations of a way at once
+            std::vector<osmium::unsigned_object_id_type> m_ids;
+            std::vector<osmium::Location> m_locations;
+
             // It is okay to have this static dummy instance, even when using several threads,
             // because it is read-only.
             static dummy_type& get_dummy() {
@@ -91,6 +96,28 @@ namespace osmium {
                 return instance;
             }
 
+            /**
+             * Look up the locations of all nodes of the way at once (so the
+             * storage can overlap the lookups). Only possible if all node
+             * ids are positive.
+             */
+            bool get_positive_locations(const osmium::Way& way) {
+                const size_t count = way.nodes().size();
+                if (m_ids.size() < count) {
+                    m_ids.resize(count);
+                    m_locations.resize(count);
+                }
+                size_t i = 0;
+                for (const auto& node_ref : way.nodes()) {
+                    if (node_ref.ref() < 0) {
+                        return false;
+                    }
+                    m_ids[i++] = static_cast<osmium::unsigned_object_id_type>(node_ref.ref());
+                }
+                m_storage_pos.get_many(m_ids.data(), count, m_locations.data());
+                return true;
+            }
+
         public:
 
             explicit NodeLocationsForWays(TStoragePosIDs& storage_pos,
@@ -146,14 +173,24 @@ namespace osmium {
                     m_must_sort = false;
                 }
                 bool error = false;
-                for (auto& node_ref : way.nodes()) {
-                    try {
-                        node_ref.set_location(get_node_location(node_ref.ref()));
+                if (get_positive_locations(way)) {
+                    size_t i = 0;
+                    for (auto& node_ref : way.nodes()) {
+                        node_ref.set_location(m_locations[i++]);
                         if (!node_ref.location()) {
                             error = true;
                         }
-                    } catch (osmium::not_found&) {
-                        error = true;
+                    }
+                } else {
+                    for (auto& node_ref : way.nodes()) {
+                        try {
+                            node_ref.set_location(get_node_location(node_ref.ref()));
+                            if (!node_ref.location()) {
+                                error = true;
+                            }
+                        } catch (osmium::not_found&) {
+                            error = true;
+                        }
                     }
                 }
                 if (error && !m_ignore_errors) {
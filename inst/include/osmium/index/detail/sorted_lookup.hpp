@@ -0,0 +1,97 @@
+#ifndef OSMIUM_INDEX_DETAIL_SORTED_LOOKUP_HPP
+#define OSMIUM_INDEX_DETAIL_SORTED_LOOKUP_HPP
+
+/*
+
+This file is part of Osmium (http://osmcode.org/libosmium).
+
+Copyright 2013-2015 Jochen Topf <jochen@topf.org> and others (see README).
+
+Boost Software License - Version 1.0 - August 17th, 2003
+
+Permission is hereby granted, free of charge, to any person or organization
+obtaining a copy of the software and accompanying documentation covered by
+this license (the "Software") to use, reproduce, display, distribute,
+execute, and transmit the Software, and to prepare derivative works of the
+Software, and to permit third-parties to whom the Software is furnished to
+do so, all subject to the following:
+
+The copyright notices in the Software and this entire statement, including
+the above license grant, this restriction and the following disclaimer,
+must be included in all copies of the Software, in whole or in part, and
+all derivative works of the Software, unless such copies or derivative
+works are solely in the form of machine-executable object code generated by
+a source language processor.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
+namespace osmium {
+
+    namespace index {
+
+        namespace detail {
+
+            /**
+             * Like std::lower_bound() on a range sorted by the first member
+             * of its elements, but the range is first searched with
+             * exponentially growing steps from its beginning. This needs
+             * O(log d) comparisons if the element is found at distance d,
+             * which makes a sequence of lookups for ascending ids cheaper
+             * than independent binary searches.
+             */
+            template <typename TIterator, typename TId>
+            TIterator gallop_lower_bound(TIterator first, TIterator last, const TId id) {
+                typedef typename std::iterator_traits<TIterator>::difference_type difference_type;
+                const difference_type size = std::distance(first, last);
+                difference_type low = 0;
+                difference_type step = 1;
+                while (step <= size && first[step - 1].first < id) {
+                    low = step;
+                    step *= 2;
+                }
+                const difference_type high = step <= size ? step - 1 : size;
+                return std::lower_bound(first + low, first + high, id, [](const typename std::iterator_traits<TIterator>::value_type& element, const TId key) {
+                    return element.first < key;
+                });
+            }
+
+            /**
+             * Call func for every element of the range [first, last) whose
+             * id is one of the ids in [ids_first, ids_last). Both ranges
+             * must be sorted by id. The range is walked only once, so the
+             * lookup of n ids costs O(n log(size / n)) comparisons instead
+             * of O(n log size). Duplicate ids are only looked up once.
+             */
+            template <typename TIterator, typename TIdIterator, typename TFunc>
+            void for_each_sorted_match(TIterator first, TIterator last, TIdIterator ids_first, TIdIterator ids_last, TFunc&& func) {
+                while (ids_first != ids_last && first != last) {
+                    const auto id = *ids_first;
+                    first = gallop_lower_bound(first, last, id);
+                    for (; first != last && first->first == id; ++first) {
+                        func(*first);
+                    }
+                    while (ids_first != ids_last && *ids_first == id) {
+                        ++ids_first;
+                    }
+                }
+            }
+
+        } // namespace detail
+
+    } // namespace index
+
+} // namespace osmium
+
+#endif // OSMIUM_INDEX_DETAIL_SORTED_LOOKUP_HPP
@@ -38,9 +38,11 @@ DEALINGS IN THE SOFTWARE.
 #include <stdexcept>
 #include <utility>
 
+#include <osmium/index/detail/sorted_lookup.hpp>
 #include <osmium/index/index.hpp>
 #include <osmium/index/map.hpp>
 #include <osmium/io/detail/read_write.hpp>
+#include <osmium/util/compatibility.hpp>
 
 namespace osmium {
 
@@ -93,6 +95,24 @@ namespace osmium {
                     }
                 }
 
+                void get_many(const TId* ids, const size_t count, TValue* values) const final {
+                    // the ids are usually far apart, so the memory for the
+                    // next lookups is requested while the current one is done
+                    constexpr size_t prefetch_distance = 8;
+                    const size_t size = m_vector.size();
+                    for (size_t i = 0; i < count && i < prefetch_distance; ++i) {
+                        if (ids[i] < size) {
+                            OSMIUM_PREFETCH(&m_vector[ids[i]]);
+                        }
+                    }
+                    for (size_t i = 0; i < count; ++i) {
+                        if (i + prefetch_distance < count && ids[i + prefetch_distance] < size) {
+                            OSMIUM_PREFETCH(&m_vector[ids[i + prefetch_distance]]);
+                        }
+                        values[i] = ids[i] < size ? m_vector[ids[i]] : osmium::index::empty_value<TValue>();
+                    }
+                }
+
                 size_t size() const final {
                     return m_vector.size();
                 }
@@ -155,20 +175,30 @@ namespace osmium {
 
                 vector_type m_vector;
 
+                // Whether the ids were set in ascending order (as they are
+                // in sorted files), so sort() has nothing to do.
+                bool m_sorted;
+
             public:
 
                 VectorBasedSparseMap() :
-                    m_vector() {
+                    m_vector(),
+                    m_sorted(true) {
                 }
 
                 explicit VectorBasedSparseMap(int fd) :
-                    m_vector(fd) {
+                    m_vector(fd),
+                    m_sorted(false) {
                 }
 
                 ~VectorBasedSparseMap() final = default;
 
                 void set(const TId id, const TValue value) final {
-                    m_vector.push_back(element_type(id, value));
+                    const element_type element {id, value};
+                    if (m_sorted && m_vector.size() > 0 && element < m_vector.back()) {
+                        m_sorted = false;
+                    }
+                    m_vector.push_back(element);
                 }
 
                 const TValue get(const TId id) const final {
@@ -186,6 +216,55 @@ namespace osmium {
                     }
                 }
 
+                /**
+                 * Does the binary searches for up to batch_size ids in
+                 * lockstep. The memory of the next step of every search is
+                 * prefetched, so the cache misses of the searches overlap.
+                 */
+                void get_many(const TId* ids, const size_t count, TValue* values) const final {
+                    constexpr size_t batch_size = 16;
+                    const element_type* data = m_vector.data();
+                    const size_t size = m_vector.size();
+                    size_t base[batch_size];
+                    for (size_t first = 0; first < count; first += batch_size) {
+                        const size_t n = std::min(batch_size, count - first);
+                        for (size_t j = 0; j < n; ++j) {
+                            base[j] = 0;
+                        }
+                        size_t length = size;
+                        while (length > 1) {
+                            const size_t half = length / 2;
+                            length -= half;
+                            for (size_t j = 0; j < n; ++j) {
+                                if (data[base[j] + half].first < ids[first + j]) {
+                                    base[j] += half;
+                                }
+                                OSMIUM_PREFETCH(&data[base[j] + length / 2]);
+                            }
+                        }
+                        for (size_t j = 0; j < n; ++j) {
+                            const TId id = ids[first + j];
+                            size_t pos = base[j];
+                            if (pos < size && data[pos].first < id) {
+                                ++pos;
+                            }
+                            values[first + j] = (pos < size && data[pos].first == id) ? data[pos].second : osmium::index::empty_value<TValue>();
+                        }
+                    }
+                }
+
+                void get_sorted(const TId* ids, const size_t count, TValue* values) const final {
+                    auto it = m_vector.begin();
+                    for (size_t i = 0; i < count; ++i) {
+                        it = osmium::index::detail::gallop_lower_bound(it, m_vector.end(), ids[i]);
+                        if (it == m_vector.end() || it->first != ids[i]) {
+                            values[i] = osmium::index::empty_value<TValue>();
+                        } else {
+                            values[i] = it->second;
+                        }
+                    }
+                }
+
                 size_t size() const final {
                     return m_vector.size();
                 }
@@ -201,10 +280,14 @@ namespace osmium {
                 void clear() final {
                     m_vector.clear();
                     m_vector.shrink_to_fit();
+                    m_sorted = true;
                 }
 
                 void sort() final {
-                    std::sort(m_vector.begin(), m_vector.end());
+                    if (!m_sorted) {
+                        std::sort(m_vector.begin(), m_vector.end());
+                        m_sorted = true;
+                    }
                 }
 
                 void dump_as_list(const int fd) final {
@@ -37,6 +37,7 @@ DEALINGS IN THE SOFTWARE.
 #include <cstddef>
 #include <utility>
 
+#include <osmium/index/detail/sorted_lookup.hpp>
 #include <osmium/index/index.hpp>
 #include <osmium/index/multimap.hpp>
 #include <osmium/io/detail/read_write.hpp>
@@ -61,7 +62,7 @@ namespace osmium {
 
                 vector_type m_vector;
 
-                static bool is_removed(element_type& element) {
+                static bool is_removed(const element_type& element) {
                     return element.second == osmium::index::empty_value<TValue>();
                 }
 
@@ -105,6 +106,20 @@ namespace osmium {
                     });
                 }
 
+                /**
+                 * Call func for all elements with one of the given ids. The
+                 * ids must be sorted. This is much faster than calling
+                 * get_all() for every id if many ids are looked up.
+                 */
+                template <typename TIdIterator, typename TFunc>
+                void get_all_sorted(TIdIterator ids_first, TIdIterator ids_last, TFunc&& func) const {
+                    osmium::index::detail::for_each_sorted_match(m_vector.cbegin(), m_vector.cend(), ids_first, ids_last, [&func](const element_type& element) {
+                        if (!is_removed(element)) {
+                            func(element);
+                        }
+                    });
+                }
+
                 size_t size() const final {
                     return m_vector.size();
                 }
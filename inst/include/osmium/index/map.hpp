@@ -43,6 +43,7 @@ DEALINGS IN THE SOFTWARE.
 #include <type_traits>
 #include <vector>
 
+#include <osmium/index/index.hpp>
 #include <osmium/util/compatibility.hpp>
 #include <osmium/util/string.hpp>
 
@@ -117,6 +118,30 @@ namespace osmium {
                 /// Retrieve value by id. Does not check for overflow or empty fields.
                 virtual const TValue get(const TId id) const = 0;
 
+                /**
+                 * Retrieve the values of count ids at once. Values of ids
+                 * not in the storage are set to the empty value. Storage
+                 * classes can overlap the memory accesses of the lookups.
+                 * The default implementation looks up every id on its own.
+                 */
+                virtual void get_many(const TId* ids, const size_t count, TValue* values) const {
+                    for (size_t i = 0; i < count; ++i) {
+                        try {
+                            values[i] = get(ids[i]);
+                        } catch (const osmium::not_found&) {
+                            values[i] = osmium::index::empty_value<TValue>();
+                        }
+                    }
+                }
+
+                /**
+                 * Like get_many(), but the ids must be sorted. The default
+                 * implementation calls get_many().
+                 */
+                virtual void get_sorted(const TId* ids, const size_t count, TValue* values) const {
+                    get_many(ids, count, values);
+                }
+
                 /**
                  * Get the approximate number of items in the storage. The storage
                  * might allocate memory in blocks, so this size might not be
@@ -0,0 +1,308 @@
+#ifndef OSMIUM_INDEX_MAP_COMPRESSED_MEM_ARRAY_HPP
+#define OSMIUM_INDEX_MAP_COMPRESSED_MEM_ARRAY_HPP
+
+/*
+
+This file is part of Osmium (http://osmcode.org/libosmium).
+
+Copyright 2013-2015 Jochen Topf <jochen@topf.org> and others (see README).
+
+Boost Software License - Version 1.0 - August 17th, 2003
+
+Permission is hereby granted, free of charge, to any person or organization
+obtaining a copy of the software and accompanying documentation covered by
+this license (the "Software") to use, reproduce, display, distribute,
+execute, and transmit the Software, and to prepare derivative works of the
+Software, and to permit third-parties to whom the Software is furnished to
+do so, all subject to the following:
+
+The copyright notices in the Software and this entire statement, including
+the above license grant, this restriction and the following disclaimer,
+must be included in all copies of the Software, in whole or in part, and
+all derivative works of the Software, unless such copies or derivative
+works are solely in the form of machine-executable object code generated by
+a source language processor.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <protozero/varint.hpp>
+
+#include <osmium/index/index.hpp>
+#include <osmium/index/map.hpp>
+#include <osmium/osm/location.hpp>
+
+#define OSMIUM_HAS_INDEX_MAP_COMPRESSED_MEM_ARRAY
+
+namespace osmium {
+
+    namespace index {
+
+        namespace map {
+
+            /**
+             * Sparse storage for node locations which needs much less
+             * memory than SparseMemArray. The (id, location) pairs are
+             * stored in blocks of block_size pairs. Inside a block the ids
+             * and coordinates are delta encoded as zigzag varints, so
+             * nearby nodes with nearby ids need only a few bytes each. A
+             * block header with the first id allows finding the block by
+             * binary search. The last recently decoded blocks are kept in
+             * a small cache.
+             *
+             * Like SparseMemArray, sort() must be called after the last
+             * set() and before get(). If the ids are set in ascending order
+             * (as in sorted files), sort() has nothing to do, otherwise it
+             * temporarily needs the memory of an uncompressed index.
+             *
+             * Because of the cache, get() must not be called from several
+             * threads at the same time.
+             */
+            template <typename TId, typename TValue>
+            class CompressedMemArray : public Map<TId, TValue> {
+
+                static_assert(std::is_same<TValue, osmium::Location>::value, "CompressedMemArray can only store locations");
+
+            public:
+
+                typedef typename std::pair<TId, TValue> element_type;
+
+                /// Number of pairs in a block
+                static constexpr size_t block_size = 128;
+
+                /// Number of decoded blocks kept in the cache
+                static constexpr size_t cache_size = 16;
+
+            private:
+
+                struct block_header {
+                    TId first_id;
+                    size_t offset;
+                    int32_t first_x;
+                    int32_t first_y;
+                    uint32_t count;
+                };
+
+                struct cache_entry {
+                    size_t block = std::numeric_limits<size_t>::max();
+                    uint32_t count = 0;
+                    TId ids[block_size];
+                    TValue values[block_size];
+                };
+
+                std::vector<block_header> m_blocks;
+
+                // encoded pairs of all blocks
+                std::string m_data;
+
+                // pairs not yet encoded, the last block is incomplete
+                std::vector<element_type> m_pending;
+
+                size_t m_size = 0;
+
+                TId m_last_id = 0;
+
+                bool m_sorted = true;
+
+                mutable std::vector<cache_entry> m_cache;
+
+                void encode_block(const element_type* elements, const size_t count) {
+                    m_blocks.push_back(block_header{elements[0].first, m_data.size(), elements[0].second.x(), elements[0].second.y(), static_cast<uint32_t>(count)});
+                    auto out = std::back_inserter(m_data);
+                    for (size_t i = 1; i < count; ++i) {
+                        const element_type& prev = elements[i - 1];
+                        const element_type& cur = elements[i];
+                        protozero::write_varint(out, protozero::encode_zigzag64(static_cast<int64_t>(cur.first - prev.first)));
+                        protozero::write_varint(out, protozero::encode_zigzag64(static_cast<int64_t>(cur.second.x()) - prev.second.x()));
+                        protozero::write_varint(out, protozero::encode_zigzag64(static_cast<int64_t>(cur.second.y()) - prev.second.y()));
+                    }
+                }
+
+                void decode_block(const size_t block, cache_entry& entry) const {
+                    const block_header& header = m_blocks[block];
+                    const char* data = m_data.data() + header.offset;
+                    const char* end = block + 1 < m_blocks.size() ? m_data.data() + m_blocks[block + 1].offset : m_data.data() + m_data.size();
+                    TId id = header.first_id;
+                    int64_t x = header.first_x;
+                    int64_t y = header.first_y;
+                    entry.ids[0] = id;
+                    entry.values[0] = TValue(static_cast<int32_t>(x), static_cast<int32_t>(y));
+                    for (uint32_t i = 1; i < header.count; ++i) {
+                        id += static_cast<TId>(protozero::decode_zigzag64(protozero::decode_varint(&data, end)));
+                        x += protozero::decode_zigzag64(protozero::decode_varint(&data, end));
+                        y += protozero::decode_zigzag64(protozero::decode_varint(&data, end));
+                        entry.ids[i] = id;
+                        entry.values[i] = TValue(static_cast<int32_t>(x), static_cast<int32_t>(y));
+                    }
+                    entry.block = block;
+                    entry.count = header.count;
+                }
+
+                const cache_entry& get_block(const size_t block) const {
+                    if (m_cache.empty()) {
+                        m_cache.resize(cache_size);
+                    }
+                    cache_entry& entry = m_cache[block % cache_size];
+                    if (entry.block != block) {
+                        decode_block(block, entry);
+                    }
+                    return entry;
+                }
+
+                bool find(const TId id, TValue& value) const {
+                    if (!m_pending.empty() && id >= m_pending.front().first) {
+                        const auto it = std::lower_bound(m_pending.begin(), m_pending.end(), id, [](const element_type& element, const TId key) {
+                            return element.first < key;
+                        });
+                        if (it != m_pending.end() && it->first == id) {
+                            value = it->second;
+                            return true;
+                        }
+                        return false;
+                    }
+                    auto block = std::upper_bound(m_blocks.begin(), m_blocks.end(), id, [](const TId key, const block_header& header) {
+                        return key < header.first_id;
+                    });
+                    if (block == m_blocks.begin()) {
+                        return false;
+                    }
+                    const cache_entry& entry = get_block(static_cast<size_t>(std::distance(m_blocks.begin(), block) - 1));
+                    const TId* it = std::lower_bound(entry.ids, entry.ids + entry.count, id);
+                    if (it == entry.ids + entry.count || *it != id) {
+                        return false;
+                    }
+                    value = entry.values[it - entry.ids];
+                    return true;
+                }
+
+                void flush_pending() {
+                    if (!m_pending.empty()) {
+                        encode_block(m_pending.data(), m_pending.size());
+                        m_pending.clear();
+                    }
+                }
+
+                void invalidate_cache() {
+                    for (auto& entry : m_cache) {
+                        entry.block = std::numeric_limits<size_t>::max();
+                    }
+                }
+
+                void rebuild_sorted() {
+                    std::vector<element_type> elements;
+                    elements.reserve(m_size);
+                    for (size_t block = 0; block < m_blocks.size(); ++block) {
+                        const cache_entry& entry = get_block(block);
+                        for (uint32_t i = 0; i < entry.count; ++i) {
+                            elements.emplace_back(entry.ids[i], entry.values[i]);
+                        }
+                    }
+                    elements.insert(elements.end(), m_pending.begin(), m_pending.end());
+                    std::sort(elements.begin(), elements.end());
+
+                    m_blocks.clear();
+                    m_data.clear();
+                    m_pending.clear();
+                    invalidate_cache();
+                    size_t first = 0;
+                    for (; first + block_size <= elements.size(); first += block_size) {
+                        encode_block(elements.data() + first, block_size);
+                    }
+                    m_pending.assign(elements.begin() + first, elements.end());
+                    m_sorted = true;
+                }
+
+            public:
+
+                CompressedMemArray() = default;
+
+                ~CompressedMemArray() noexcept final = default;
+
+                void set(const TId id, const TValue value) final {
+                    if (m_size > 0 && id < m_last_id) {
+                        m_sorted = false;
+                    }
+                    m_pending.emplace_back(id, value);
+                    m_last_id = id;
+                    ++m_size;
+                    if (m_pending.size() == block_size) {
+                        flush_pending();
+                    }
+                }
+
+                const TValue get(const TId id) const final {
+                    TValue value;
+                    if (!find(id, value)) {
+                        not_found_error(id);
+                    }
+                    return value;
+                }
+
+                void get_many(const TId* ids, const size_t count, TValue* values) const final {
+                    for (size_t i = 0; i < count; ++i) {
+                        if (!find(ids[i], values[i])) {
+                            values[i] = osmium::index::empty_value<TValue>();
+                        }
+                    }
+                }
+
+                size_t size() const final {
+                    return m_size;
+                }
+
+                size_t used_memory() const final {
+                    return m_blocks.capacity() * sizeof(block_header) +
+                           m_data.capacity() +
+                           m_pending.capacity() * sizeof(element_type) +
+                           m_cache.capacity() * sizeof(cache_entry);
+                }
+
+                void clear() final {
+                    m_blocks.clear();
+                    m_blocks.shrink_to_fit();
+                    m_data.clear();
+                    m_data.shrink_to_fit();
+                    m_pending.clear();
+                    m_pending.shrink_to_fit();
+                    m_cache.clear();
+                    m_cache.shrink_to_fit();
+                    m_size = 0;
+                    m_last_id = 0;
+                    m_sorted = true;
+                }
+
+                void sort() final {
+                    if (!m_sorted) {
+                        rebuild_sorted();
+                    }
+                    // set() is finished, release the reserve of the vectors
+                    m_blocks.shrink_to_fit();
+                    m_data.shrink_to_fit();
+                }
+
+            }; // class CompressedMemArray
+
+        } // namespace map
+
+    } // namespace index
+
+} // namespace osmium
+
+#endif // OSMIUM_INDEX_MAP_COMPRESSED_MEM_ARRAY_HPP
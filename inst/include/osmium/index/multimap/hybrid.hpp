@@ -128,6 +128,8 @@ namespace osmium {
 
             public:
 
+                typedef typename std::pair<TId, TValue> element_type;
+
                 typedef HybridIterator<TId, TValue> iterator;
                 typedef const HybridIterator<TId, TValue> const_iterator;
 
@@ -165,6 +167,29 @@ namespace osmium {
                                           iterator(result_main.second, result_main.second, result_extra.second, result_extra.second));
                 }
 
+                /**
+                 * Call func for all elements with one of the given ids. The
+                 * ids must be sorted. The elements not consolidated into the
+                 * main map yet are reported after the others.
+                 */
+                template <typename TIdIterator, typename TFunc>
+                void get_all_sorted(TIdIterator ids_first, TIdIterator ids_last, TFunc&& func) const {
+                    m_main.get_all_sorted(ids_first, ids_last, func);
+                    if (m_extra.size() == 0) {
+                        return;
+                    }
+                    while (ids_first != ids_last) {
+                        const TId id = *ids_first;
+                        const auto range = m_extra.get_all(id);
+                        for (auto it = range.first; it != range.second; ++it) {
+                            func(element_type(it->first, it->second));
+                        }
+                        while (ids_first != ids_last && *ids_first == id) {
+                            ++ids_first;
+                        }
+                    }
+                }
+
                 void remove(const TId id, const TValue value) {
                     m_main.remove(id, value);
                     m_extra.remove(id, value);
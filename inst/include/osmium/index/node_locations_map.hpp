@@ -35,6 +35,10 @@ DEALINGS IN THE SOFTWARE.
 
 #include <osmium/index/map.hpp> // IWYU pragma: keep
 
+#ifdef OSMIUM_HAS_INDEX_MAP_COMPRESSED_MEM_ARRAY
+    REGISTER_MAP(osmium::unsigned_object_id_type, osmium::Location, osmium::index::map::CompressedMemArray, compressed_mem_array)
+#endif
+
 #ifdef OSMIUM_HAS_INDEX_MAP_DENSE_FILE_ARRAY
     REGISTER_MAP(osmium::unsigned_object_id_type, osmium::Location, osmium::index::map::DenseFileArray, dense_file_array)
 #endif
@@ -61,6 +61,7 @@ namespace osmium {
                 std::promise<osmium::io::Header>& m_header_promise;
                 queue_wrapper<std::string> m_input_queue;
                 osmium::osm_entity_bits::type m_read_types;
+                osmium::io::detail::decode_options m_decode_options;
                 bool m_header_is_done;
 
             protected:
@@ -77,6 +78,15 @@ namespace osmium {
                     return m_read_types;
                 }
 
+                /**
+                 * The tag keys and the condition on the tags of the
+                 * objects needed (see File). Parsers may drop other tags
+                 * and objects.
+                 */
+                const osmium::io::detail::decode_options& decode_options() const {
+                    return m_decode_options;
+                }
+
                 bool header_is_done() const {
                     return m_header_is_done;
                 }
@@ -116,6 +126,7 @@ namespace osmium {
                     m_header_promise(header_promise),
                     m_input_queue(input_queue),
                     m_read_types(read_types),
+                    m_decode_options(),
                     m_header_is_done(false) {
                 }
 
@@ -129,6 +140,10 @@ namespace osmium {
 
                 virtual void run() = 0;
 
+                void set_decode_options(const osmium::io::detail::decode_options& options) {
+                    m_decode_options = options;
+                }
+
                 void parse() {
                     try {
                         run();
@@ -59,6 +59,7 @@ DEALINGS IN THE SOFTWARE.
 #include <osmium/osm/timestamp.hpp>
 #include <osmium/osm/way.hpp>
 #include <osmium/thread/pool.hpp>
+#include <osmium/util/profile.hpp>
 #include <osmium/visitor.hpp>
 
 namespace osmium {
@@ -138,6 +139,8 @@ namespace osmium {
                 ~OPLOutputBlock() noexcept = default;
 
                 std::string operator()() {
+                    osmium::util::ProfileTimer timer {"opl_encode"};
+                    timer.add_bytes(m_input_buffer->committed());
                     osmium::apply(m_input_buffer->cbegin(), m_input_buffer->cend(), *this);
 
                     std::string out;
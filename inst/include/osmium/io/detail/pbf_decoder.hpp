@@ -37,6 +37,7 @@ DEALINGS IN THE SOFTWARE.
 #include <cstdint>
 #include <cstring>
 #include <algorithm>
+#include <iterator>
 #include <limits>
 #include <memory>
 #include <stdexcept>
@@ -50,6 +51,7 @@ DEALINGS IN THE SOFTWARE.
 #include <osmium/io/detail/pbf.hpp> // IWYU pragma: export
 #include <osmium/io/detail/protobuf_tags.hpp>
 #include <osmium/io/detail/zlib.hpp>
+#include <osmium/io/file.hpp>
 #include <osmium/io/header.hpp>
 #include <osmium/osm/location.hpp>
 #include <osmium/osm/node.hpp>
@@ -58,6 +60,7 @@ DEALINGS IN THE SOFTWARE.
 #include <osmium/osm/entity_bits.hpp>
 #include <osmium/util/cast.hpp>
 #include <osmium/util/delta.hpp>
+#include <osmium/util/profile.hpp>
 
 namespace osmium {
 
@@ -82,6 +85,27 @@ namespace osmium {
 
                 osmium::osm_entity_bits::type m_read_types;
 
+                // keys of the tags kept, nullptr keeps all tags
+                const std::vector<std::string>* m_tag_keys;
+
+                // for every string of the string table: is it a key of a
+                // tag which is kept?
+                std::vector<bool> m_keep_key;
+
+                // objects not fulfilling the condition are not built,
+                // nullptr if all objects are built
+                const osmium::io::TagCondition* m_condition;
+
+                // matches of the patterns of the condition in the string table
+                std::vector<char> m_condition_matches;
+
+                // tags of the object checked
+                osmium::io::TagCondition::tag_indices_type m_tag_indices;
+
+                // built objects not fulfilling the predicate are removed,
+                // nullptr if all objects are kept
+                const osmium::io::object_predicate_type* m_predicate;
+
                 osmium::memory::Buffer m_buffer { initial_buffer_size };
 
                 void decode_stringtable(const ptr_len_type& data) {
@@ -97,6 +121,65 @@ namespace osmium {
                         }
                         m_stringtable.emplace_back(str_len.first, osmium::string_size_type(str_len.second));
                     }
+
+                    if (m_tag_keys) {
+                        m_keep_key.reserve(m_stringtable.size());
+                        for (const auto& str : m_stringtable) {
+                            m_keep_key.push_back(std::any_of(m_tag_keys->begin(), m_tag_keys->end(), [&str](const std::string& key) {
+                                return key.size() == str.second && !std::memcmp(key.data(), str.first, str.second);
+                            }));
+                        }
+                    }
+
+                    if (m_condition) {
+                        m_condition->match_strings(m_stringtable, m_condition_matches);
+                    }
+                }
+
+                // Must be called after the key was looked up in the string table
+                bool keep_tag(uint32_t key) const {
+                    return !m_tag_keys || m_keep_key[key];
+                }
+
+                using kv_type = std::pair<protozero::pbf_reader::const_uint32_iterator, protozero::pbf_reader::const_uint32_iterator>;
+
+                bool has_condition(osmium::osm_entity_bits::type type) const {
+                    return m_condition && (m_condition->entities() & type);
+                }
+
+                void add_tag_indices(uint32_t key, uint32_t value) {
+                    if (key >= m_stringtable.size() || value >= m_stringtable.size()) {
+                        throw std::out_of_range("string id out of range");
+                    }
+                    m_tag_indices.emplace_back(key, value);
+                }
+
+                // Checks the condition on the tags of an object of the given
+                // type before the object is built
+                bool check_condition(osmium::osm_entity_bits::type type, const kv_type& keys, const kv_type& vals) {
+                    if (!has_condition(type)) {
+                        return true;
+                    }
+                    m_tag_indices.clear();
+                    auto kit = keys.first;
+                    auto vit = vals.first;
+                    while (kit != keys.second) {
+                        if (vit == vals.second) {
+                            // this is against the spec, must have same number of elements
+                            throw osmium::pbf_error("PBF format error");
+                        }
+                        add_tag_indices(*kit++, *vit++);
+                    }
+                    return m_condition->evaluate(m_tag_indices, m_condition_matches, m_stringtable.size());
+                }
+
+                // Commits the object built last if it fulfills the predicate
+                void commit_object() {
+                    if (m_predicate && !(*m_predicate)(m_buffer.get<osmium::OSMObject>(m_buffer.committed()))) {
+                        m_buffer.rollback();
+                        return;
+                    }
+                    m_buffer.commit();
                 }
 
                 void decode_primitive_block_metadata() {
@@ -209,8 +292,6 @@ namespace osmium {
                     return user;
                 }
 
-                using kv_type = std::pair<protozero::pbf_reader::const_uint32_iterator, protozero::pbf_reader::const_uint32_iterator>;
-
                 void build_tag_list(osmium::builder::Builder& builder, const kv_type& keys, const kv_type& vals) {
                     if (keys.first != keys.second) {
                         osmium::builder::TagListBuilder tl_builder(m_buffer, &builder);
@@ -221,9 +302,12 @@ namespace osmium {
                                 // this is against the spec, must have same number of elements
                                 throw osmium::pbf_error("PBF format error");
                             }
-                            const auto& k = m_stringtable.at(*kit++);
+                            const auto key = *kit++;
+                            const auto& k = m_stringtable.at(key);
                             const auto& v = m_stringtable.at(*vit++);
-                            tl_builder.add_tag(k.first, k.second, v.first, v.second);
+                            if (keep_tag(key)) {
+                                tl_builder.add_tag(k.first, k.second, v.first, v.second);
+                            }
                         }
                     }
                 }
@@ -269,6 +353,11 @@ namespace osmium {
                         }
                     }
 
+                    if (!check_condition(osmium::osm_entity_bits::node, keys, vals)) {
+                        m_buffer.rollback();
+                        return;
+                    }
+
                     if (node.visible()) {
                         if (lon == std::numeric_limits<int64_t>::max() ||
                             lat == std::numeric_limits<int64_t>::max()) {
@@ -284,7 +373,7 @@ namespace osmium {
 
                     build_tag_list(builder, keys, vals);
 
-                    m_buffer.commit();
+                    commit_object();
                 }
 
                 void decode_way(const ptr_len_type& data) {
@@ -319,6 +408,11 @@ namespace osmium {
                         }
                     }
 
+                    if (!check_condition(osmium::osm_entity_bits::way, keys, vals)) {
+                        m_buffer.rollback();
+                        return;
+                    }
+
                     builder.add_user(user.first, user.second);
 
                     if (refs.first != refs.second) {
@@ -331,7 +425,7 @@ namespace osmium {
 
                     build_tag_list(builder, keys, vals);
 
-                    m_buffer.commit();
+                    commit_object();
                 }
 
                 void decode_relation(const ptr_len_type& data) {
@@ -374,6 +468,11 @@ namespace osmium {
                         }
                     }
 
+                    if (!check_condition(osmium::osm_entity_bits::relation, keys, vals)) {
+                        m_buffer.rollback();
+                        return;
+                    }
+
                     builder.add_user(user.first, user.second);
 
                     if (refs.first != refs.second) {
@@ -396,7 +495,7 @@ namespace osmium {
 
                     build_tag_list(builder, keys, vals);
 
-                    m_buffer.commit();
+                    commit_object();
                 }
 
                 void decode_dense_nodes(const ptr_len_type& data) {
@@ -476,6 +575,7 @@ namespace osmium {
                     osmium::util::DeltaDecode<int64_t> dense_timestamp;
 
                     auto tag_it = tags.first;
+                    const bool dense_condition = has_condition(osmium::osm_entity_bits::node);
 
                     while (ids.first != ids.second) {
                         if (lons.first == lons.second ||
@@ -542,15 +642,38 @@ namespace osmium {
                             ));
                         }
 
+                        if (dense_condition) {
+                            m_tag_indices.clear();
+                            auto it = tag_it;
+                            while (it != tags.second && *it != 0) {
+                                const auto key = *it++;
+                                if (it == tags.second) {
+                                    throw osmium::pbf_error("PBF format error"); // this is against the spec, keys/vals must come in pairs
+                                }
+                                add_tag_indices(key, *it++);
+                            }
+                            if (!m_condition->evaluate(m_tag_indices, m_condition_matches, m_stringtable.size())) {
+                                if (it != tags.second) {
+                                    ++it;
+                                }
+                                tag_it = it;
+                                m_buffer.rollback();
+                                continue;
+                            }
+                        }
+
                         if (tag_it != tags.second) {
                             osmium::builder::TagListBuilder tl_builder(m_buffer, &builder);
                             while (tag_it != tags.second && *tag_it != 0) {
-                                const auto& k = m_stringtable.at(*tag_it++);
+                                const auto key = *tag_it++;
+                                const auto& k = m_stringtable.at(key);
                                 if (tag_it == tags.second) {
                                     throw osmium::pbf_error("PBF format error"); // this is against the spec, keys/vals must come in pairs
                                 }
                                 const auto& v = m_stringtable.at(*tag_it++);
-                                tl_builder.add_tag(k.first, k.second, v.first, v.second);
+                                if (keep_tag(key)) {
+                                    tl_builder.add_tag(k.first, k.second, v.first, v.second);
+                                }
                             }
 
                             if (tag_it != tags.second) {
@@ -558,16 +681,26 @@ namespace osmium {
                             }
                         }
 
-                        m_buffer.commit();
+                        commit_object();
                     }
 
                 }
 
             public:
 
-                PBFPrimitiveBlockDecoder(const ptr_len_type& data, osmium::osm_entity_bits::type read_types) :
+                /**
+                 * @param options Keys of the tags kept, condition on the
+                 *                tags of the objects built and predicate
+                 *                on the objects returned (see
+                 *                osmium::io::File). The options must be
+                 *                valid while the decoder is used.
+                 */
+                PBFPrimitiveBlockDecoder(const ptr_len_type& data, osmium::osm_entity_bits::type read_types, const osmium::io::detail::decode_options& options = osmium::io::detail::decode_options()) :
                     m_data(data),
-                    m_read_types(read_types) {
+                    m_read_types(read_types),
+                    m_tag_keys(options.tag_keys.get()),
+                    m_condition(options.tag_condition && !options.tag_condition->empty() ? options.tag_condition.get() : nullptr),
+                    m_predicate(options.object_predicate ? &options.object_predicate : nullptr) {
                 }
 
                 PBFPrimitiveBlockDecoder(const PBFPrimitiveBlockDecoder&) = delete;
@@ -744,12 +877,14 @@ namespace osmium {
 
                 std::shared_ptr<std::string> m_input_buffer;
                 osmium::osm_entity_bits::type m_read_types;
+                osmium::io::detail::decode_options m_options;
 
             public:
 
-                PBFDataBlobDecoder(std::string&& input_buffer, osmium::osm_entity_bits::type read_types) :
+                PBFDataBlobDecoder(std::string&& input_buffer, osmium::osm_entity_bits::type read_types, const osmium::io::detail::decode_options& options = osmium::io::detail::decode_options()) :
                     m_input_buffer(std::make_shared<std::string>(std::move(input_buffer))),
-                    m_read_types(read_types) {
+                    m_read_types(read_types),
+                    m_options(options) {
                 }
 
                 PBFDataBlobDecoder(const PBFDataBlobDecoder&) = default;
@@ -762,8 +897,21 @@ namespace osmium {
 
                 osmium::memory::Buffer operator()() {
                     std::string output;
-                    PBFPrimitiveBlockDecoder decoder(decode_blob(*m_input_buffer, output), m_read_types);
-                    return decoder();
+                    osmium::util::Profile& profile = osmium::util::Profile::instance();
+                    ptr_len_type data;
+                    {
+                        osmium::util::ProfileTimer timer {profile.stage("pbf_decompress")};
+                        data = decode_blob(*m_input_buffer, output);
+                        timer.add_bytes(m_input_buffer->size());
+                    }
+                    osmium::util::ProfileTimer timer {profile.stage("pbf_decode")};
+                    PBFPrimitiveBlockDecoder decoder(data, m_read_types, m_options);
+                    osmium::memory::Buffer buffer = decoder();
+                    if (timer.active()) {
+                        timer.add_items(static_cast<uint64_t>(std::distance(buffer.begin<osmium::OSMEntity>(), buffer.end<osmium::OSMEntity>())));
+                        timer.add_bytes(data.second);
+                    }
+                    return buffer;
                 }
 
             }; // class PBFDataBlobDecoder
@@ -73,6 +73,7 @@ DEALINGS IN THE SOFTWARE.
 #include <osmium/thread/pool.hpp>
 #include <osmium/util/cast.hpp>
 #include <osmium/util/delta.hpp>
+#include <osmium/util/profile.hpp>
 #include <osmium/visitor.hpp>
 
 namespace osmium {
@@ -167,6 +168,9 @@ namespace osmium {
                 std::string operator()() {
                     assert(m_msg.size() <= max_uncompressed_blob_size);
 
+                    osmium::util::ProfileTimer timer {"pbf_serialize"};
+                    timer.add_bytes(m_msg.size());
+
                     std::string blob_data;
                     protozero::pbf_builder<FileFormat::Blob> pbf_blob(blob_data);
 
@@ -42,6 +42,7 @@ DEALINGS IN THE SOFTWARE.
 #include <osmium/io/compression.hpp>
 #include <osmium/io/detail/queue_util.hpp>
 #include <osmium/thread/util.hpp>
+#include <osmium/util/profile.hpp>
 
 namespace osmium {
 
@@ -71,8 +72,14 @@ namespace osmium {
                     osmium::thread::set_thread_name("_osmium_read");
 
                     try {
+                        osmium::util::Profile::Stage* stage = osmium::util::Profile::instance().stage("input");
                         while (!m_done) {
-                            std::string data {m_decompressor.read()};
+                            std::string data;
+                            {
+                                osmium::util::ProfileTimer timer {stage};
+                                data = m_decompressor.read();
+                                timer.add_bytes(data.size());
+                            }
                             if (at_end_of_data(data)) {
                                 break;
                             }
@@ -41,6 +41,7 @@ DEALINGS IN THE SOFTWARE.
 #include <osmium/io/compression.hpp>
 #include <osmium/io/detail/queue_util.hpp>
 #include <osmium/thread/util.hpp>
+#include <osmium/util/profile.hpp>
 
 namespace osmium {
 
@@ -81,11 +82,14 @@ namespace osmium {
                     osmium::thread::set_thread_name("_osmium_write");
 
                     try {
+                        osmium::util::Profile::Stage* stage = osmium::util::Profile::instance().stage("output");
                         while (true) {
                             std::string data = m_queue.pop();
                             if (at_end_of_data(data)) {
                                 break;
                             }
+                            osmium::util::ProfileTimer timer {stage};
+                            timer.add_bytes(data.size());
                             m_compressor->write(data);
                         }
                         m_compressor->close();
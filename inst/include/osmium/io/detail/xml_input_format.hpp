@@ -64,6 +64,7 @@ DEALINGS IN THE SOFTWARE.
 #include <osmium/thread/queue.hpp>
 #include <osmium/thread/util.hpp>
 #include <osmium/util/cast.hpp>
+#include <osmium/util/profile.hpp>
 
 namespace osmium {
 
@@ -636,9 +637,12 @@ namespace osmium {
                     osmium::thread::set_thread_name("_osmium_xml_in");
 
                     ExpatXMLParser<XMLParser> parser(this);
+                    osmium::util::Profile::Stage* stage = osmium::util::Profile::instance().stage("xml_parse");
 
                     while (!input_done()) {
                         std::string data = get_input();
+                        osmium::util::ProfileTimer timer {stage};
+                        timer.add_bytes(data.size());
                         parser(data, input_done());
                         if (read_types() == osmium::osm_entity_bits::nothing && header_is_done()) {
                             break;
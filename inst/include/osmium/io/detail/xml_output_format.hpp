@@ -62,6 +62,7 @@ DEALINGS IN THE SOFTWARE.
 #include <osmium/osm/types.hpp>
 #include <osmium/osm/way.hpp>
 #include <osmium/thread/pool.hpp>
+#include <osmium/util/profile.hpp>
 #include <osmium/visitor.hpp>
 
 namespace osmium {
@@ -227,6 +228,8 @@ namespace osmium {
                 ~XMLOutputBlock() noexcept = default;
 
                 std::string operator()() {
+                    osmium::util::ProfileTimer timer {"xml_encode"};
+                    timer.add_bytes(m_input_buffer->committed());
                     osmium::apply(m_input_buffer->cbegin(), m_input_buffer->cend(), *this);
 
                     if (m_options.use_change_ops) {
@@ -34,19 +34,25 @@ DEALINGS IN THE SOFTWARE.
 */
 
 #include <cstddef>
+#include <functional>
+#include <memory>
 #include <stdexcept>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <osmium/io/error.hpp>
 #include <osmium/io/file_format.hpp>
 #include <osmium/io/file_compression.hpp>
+#include <osmium/io/tag_condition.hpp>
 #include <osmium/util/options.hpp>
 #include <osmium/util/compatibility.hpp>
 
 namespace osmium {
 
+    class OSMObject;
+
     /**
      * @brief Everything related to input and output of OSM data.
      */
@@ -66,6 +72,41 @@ namespace osmium {
 
         } // namespace detail
 
+        /**
+         * Keys of the tags an application needs. Readers may drop all
+         * other tags while decoding. A nullptr means all tags are needed.
+         */
+        typedef std::shared_ptr<const std::vector<std::string>> tag_keys_type;
+
+        /**
+         * Condition on the tags of the objects an application needs.
+         * Readers may drop objects not fulfilling it. A nullptr means
+         * all objects are needed.
+         */
+        typedef std::shared_ptr<const TagCondition> tag_condition_type;
+
+        /**
+         * Predicate on the complete objects an application needs.
+         * Readers may drop objects for which it returns false. It is
+         * called from the threads decoding the input concurrently, so it
+         * must be thread safe. An empty function means all objects are
+         * needed.
+         */
+        typedef std::function<bool(const osmium::OSMObject&)> object_predicate_type;
+
+        namespace detail {
+
+            /**
+             * Settings of a File which allow parsers to decode less.
+             */
+            struct decode_options {
+                tag_keys_type tag_keys {nullptr};
+                tag_condition_type tag_condition {nullptr};
+                object_predicate_type object_predicate {};
+            }; // struct decode_options
+
+        } // namespace detail
+
         /**
          * This class describes an OSM file in one of several different formats.
          *
@@ -88,6 +129,8 @@ namespace osmium {
 
             bool m_has_multiple_object_versions {false};
 
+            detail::decode_options m_decode_options;
+
         public:
 
             /**
@@ -306,6 +349,56 @@ namespace osmium {
                 return *this;
             }
 
+            const detail::decode_options& decode_options() const noexcept {
+                return m_decode_options;
+            }
+
+            const tag_keys_type& tag_keys() const noexcept {
+                return m_decode_options.tag_keys;
+            }
+
+            /**
+             * Only the tags with the given keys are needed when reading
+             * this file. Other tags may be dropped (the PBF parser does,
+             * the other parsers keep all tags). Set to nullptr (the
+             * default) to keep all tags.
+             */
+            File& set_tag_keys(tag_keys_type keys) {
+                m_decode_options.tag_keys = std::move(keys);
+                return *this;
+            }
+
+            const tag_condition_type& tag_condition() const noexcept {
+                return m_decode_options.tag_condition;
+            }
+
+            /**
+             * Only the objects fulfilling the condition are needed when
+             * reading this file. Other objects of the entity types of the
+             * condition may be dropped (the PBF parser does, the other
+             * parsers return all objects). Set to nullptr (the default)
+             * to return all objects.
+             */
+            File& set_tag_condition(tag_condition_type condition) {
+                m_decode_options.tag_condition = std::move(condition);
+                return *this;
+            }
+
+            const object_predicate_type& object_predicate() const noexcept {
+                return m_decode_options.object_predicate;
+            }
+
+            /**
+             * Only the objects fulfilling the predicate are needed when
+             * reading this file. The PBF parser checks the predicate on
+             * each object after it has been built, the other parsers
+             * return all objects. The tag condition is checked first.
+             */
+            File& set_object_predicate(object_predicate_type predicate) {
+                m_decode_options.object_predicate = std::move(predicate);
+                return *this;
+            }
+
             File& filename(const std::string& filename) {
                 if (filename == "-") {
                     m_filename = "";
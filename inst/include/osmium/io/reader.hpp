@@ -62,6 +62,7 @@ DEALINGS IN THE SOFTWARE.
 #include <osmium/memory/buffer.hpp>
 #include <osmium/osm/entity_bits.hpp>
 #include <osmium/thread/util.hpp>
+#include <osmium/util/profile.hpp>
 
 namespace osmium {
 
@@ -113,6 +114,7 @@ namespace osmium {
                 std::promise<osmium::io::Header> promise = std::move(header_promise);
                 auto creator = detail::ParserFactory::instance().get_creator_function(file);
                 auto parser = creator(input_queue, osmdata_queue, promise, read_which_entities);
+                parser->set_decode_options(file.decode_options());
                 parser->parse();
             }
 
@@ -324,8 +326,12 @@ namespace osmium {
                     // or a valid buffer with or without data. A valid buffer
                     // without data is not an error, it just means we have to
                     // keep getting the next buffer until there is one with data.
+                    // The time spent here is the time the caller waits for
+                    // the input threads.
+                    osmium::util::ProfileTimer timer {"reader_wait"};
                     while (true) {
                         buffer = m_osmdata_queue_wrapper.pop();
+                        timer.add_bytes(buffer.committed());
                         if (detail::at_end_of_data(buffer)) {
                             m_status = status::eof;
                             m_read_thread_manager.close();
@@ -0,0 +1,246 @@
+#ifndef OSMIUM_IO_TAG_CONDITION_HPP
+#define OSMIUM_IO_TAG_CONDITION_HPP
+
+/*
+
+This file is part of Osmium (http://osmcode.org/libosmium).
+
+Copyright 2013-2015 Jochen Topf <jochen@topf.org> and others (see README).
+
+Boost Software License - Version 1.0 - August 17th, 2003
+
+Permission is hereby granted, free of charge, to any person or organization
+obtaining a copy of the software and accompanying documentation covered by
+this license (the "Software") to use, reproduce, display, distribute,
+execute, and transmit the Software, and to prepare derivative works of the
+Software, and to permit third-parties to whom the Software is furnished to
+do so, all subject to the following:
+
+The copyright notices in the Software and this entire statement, including
+the above license grant, this restriction and the following disclaimer,
+must be included in all copies of the Software, in whole or in part, and
+all derivative works of the Software, unless such copies or derivative
+works are solely in the form of machine-executable object code generated by
+a source language processor.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <osmium/osm/entity_bits.hpp>
+
+namespace osmium {
+
+    namespace io {
+
+        /**
+         * A condition on the tags of objects which readers can check
+         * before objects are built. The PBF parser matches the strings
+         * of the condition once against the string table of a block and
+         * then evaluates the condition on the string indices of the tags.
+         * Objects of the entity types of the condition which don't
+         * fulfill it are not returned.
+         *
+         * The condition is built from leaves (keys, values or tags equal
+         * to a string or matching a regular expression) combined with
+         * negation, conjunction and disjunction. After it is built it
+         * is not changed any more and can be shared between threads.
+         */
+        class TagCondition {
+
+        public:
+
+            typedef int32_t node_id;
+
+            enum class node_type : uint8_t {
+                key         = 0, // any key matches pattern first
+                value       = 1, // any value matches pattern first
+                tag         = 2, // key matches pattern first and value pattern second
+                negation    = 3, // child first
+                conjunction = 4, // children first and second
+                disjunction = 5  // children first and second
+            }; // enum class node_type
+
+            /// Tags as pairs of string table indices of key and value
+            typedef std::vector<std::pair<uint32_t, uint32_t>> tag_indices_type;
+
+        private:
+
+            struct node {
+                node_type type;
+                node_id first;
+                node_id second;
+            }; // struct node
+
+            struct pattern {
+                std::string str;
+                bool is_regex;
+                std::regex regex;
+            }; // struct pattern
+
+            std::vector<node> m_nodes;
+            std::vector<pattern> m_patterns;
+            node_id m_root = -1;
+            osmium::osm_entity_bits::type m_entities = osmium::osm_entity_bits::nwr;
+
+            node_id add_pattern(const std::string& str, bool is_regex) {
+                m_patterns.push_back(pattern{str, is_regex, is_regex ? std::regex(str) : std::regex()});
+                return static_cast<node_id>(m_patterns.size() - 1);
+            }
+
+            node_id add_node(node_type type, node_id first, node_id second) {
+                m_nodes.push_back(node{type, first, second});
+                return static_cast<node_id>(m_nodes.size() - 1);
+            }
+
+            bool pattern_matches(const pattern& p, const char* str, uint32_t size) const {
+                if (p.is_regex) {
+                    return std::regex_match(str, str + size, p.regex);
+                }
+                return p.str.size() == size && !std::memcmp(p.str.data(), str, size);
+            }
+
+            bool evaluate(node_id id, const tag_indices_type& tags, const std::vector<char>& matches, size_t num_strings) const {
+                const node& n = m_nodes[id];
+                switch (n.type) {
+                    case node_type::key:
+                        for (const auto& tag : tags) {
+                            if (matches[n.first * num_strings + tag.first]) {
+                                return true;
+                            }
+                        }
+                        return false;
+                    case node_type::value:
+                        for (const auto& tag : tags) {
+                            if (matches[n.first * num_strings + tag.second]) {
+                                return true;
+                            }
+                        }
+                        return false;
+                    case node_type::tag:
+                        for (const auto& tag : tags) {
+                            if (matches[n.first * num_strings + tag.first] && matches[n.second * num_strings + tag.second]) {
+                                return true;
+                            }
+                        }
+                        return false;
+                    case node_type::negation:
+                        return !evaluate(n.first, tags, matches, num_strings);
+                    case node_type::conjunction:
+                        return evaluate(n.first, tags, matches, num_strings) && evaluate(n.second, tags, matches, num_strings);
+                    case node_type::disjunction:
+                        return evaluate(n.first, tags, matches, num_strings) || evaluate(n.second, tags, matches, num_strings);
+                }
+                return true;
+            }
+
+        public:
+
+            /// Any key is equal to key.
+            node_id key(const std::string& key) {
+                return add_node(node_type::key, add_pattern(key, false), -1);
+            }
+
+            /// Any key matches the regular expression (ECMAScript).
+            node_id key_regex(const std::string& regex) {
+                return add_node(node_type::key, add_pattern(regex, true), -1);
+            }
+
+            /// Any value is equal to value.
+            node_id value(const std::string& value) {
+                return add_node(node_type::value, add_pattern(value, false), -1);
+            }
+
+            /// Any value matches the regular expression (ECMAScript).
+            node_id value_regex(const std::string& regex) {
+                return add_node(node_type::value, add_pattern(regex, true), -1);
+            }
+
+            /// A tag has the given key and value.
+            node_id tag(const std::string& key, const std::string& value) {
+                const node_id key_pattern = add_pattern(key, false);
+                return add_node(node_type::tag, key_pattern, add_pattern(value, false));
+            }
+
+            node_id negation(node_id child) {
+                return add_node(node_type::negation, child, -1);
+            }
+
+            node_id conjunction(node_id first, node_id second) {
+                return add_node(node_type::conjunction, first, second);
+            }
+
+            node_id disjunction(node_id first, node_id second) {
+                return add_node(node_type::disjunction, first, second);
+            }
+
+            /// Sets the node evaluated by the condition.
+            void set_root(node_id root) {
+                if (root < 0 || static_cast<size_t>(root) >= m_nodes.size()) {
+                    throw std::invalid_argument("invalid root of tag condition");
+                }
+                m_root = root;
+            }
+
+            bool empty() const noexcept {
+                return m_root < 0;
+            }
+
+            /// Only objects of these types are checked, the others are always returned.
+            void set_entities(osmium::osm_entity_bits::type entities) noexcept {
+                m_entities = entities;
+            }
+
+            osmium::osm_entity_bits::type entities() const noexcept {
+                return m_entities;
+            }
+
+            /**
+             * Matches the patterns of the condition against the strings
+             * of a string table (pairs of pointer and size). The result
+             * is passed to evaluate().
+             */
+            template <typename TStrings>
+            void match_strings(const TStrings& strings, std::vector<char>& matches) const {
+                matches.assign(m_patterns.size() * strings.size(), 0);
+                for (size_t p = 0; p < m_patterns.size(); ++p) {
+                    for (size_t i = 0; i < strings.size(); ++i) {
+                        matches[p * strings.size() + i] = pattern_matches(m_patterns[p], strings[i].first, strings[i].second);
+                    }
+                }
+            }
+
+            /**
+             * Evaluate the condition on the tags of an object given as
+             * string table indices. All indices must be smaller than
+             * num_strings. An empty condition is always fulfilled.
+             */
+            bool evaluate(const tag_indices_type& tags, const std::vector<char>& matches, size_t num_strings) const {
+                if (empty()) {
+                    return true;
+                }
+                return evaluate(m_root, tags, matches, num_strings);
+            }
+
+        }; // class TagCondition
+
+    } // namespace io
+
+} // namespace osmium
+
+#endif // OSMIUM_IO_TAG_CONDITION_HPP
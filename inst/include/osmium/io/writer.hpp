@@ -52,6 +52,7 @@ DEALINGS IN THE SOFTWARE.
 #include <osmium/io/writer_options.hpp>
 #include <osmium/memory/buffer.hpp>
 #include <osmium/thread/util.hpp>
+#include <osmium/util/profile.hpp>
 
 namespace osmium {
 
@@ -116,6 +117,8 @@ namespace osmium {
 
             void do_write(osmium::memory::Buffer&& buffer) {
                 if (buffer && buffer.committed() > 0) {
+                    osmium::util::ProfileTimer timer {"writer_submit"};
+                    timer.add_bytes(buffer.committed());
                     m_output->write_buffer(std::move(buffer));
                 }
             }
@@ -128,6 +131,8 @@ namespace osmium {
                     using std::swap;
                     swap(m_buffer, buffer);
 
+                    osmium::util::ProfileTimer timer {"writer_submit"};
+                    timer.add_bytes(buffer.committed());
                     m_output->write_buffer(std::move(buffer));
                 }
             }
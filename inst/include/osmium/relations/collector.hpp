@@ -37,9 +37,9 @@ DEALINGS IN THE SOFTWARE.
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
-#include <iomanip>
-//#include <iostream>
+#include <memory>
 #include <vector>
 
 #include <osmium/fwd.hpp>
@@ -48,6 +48,7 @@ DEALINGS IN THE SOFTWARE.
 #include <osmium/osm/relation.hpp> // IWYU pragma: keep
 #include <osmium/osm/types.hpp>
 #include <osmium/handler.hpp>
+#include <osmium/index/detail/mmap_vector_file.hpp>
 #include <osmium/memory/buffer.hpp>
 #include <osmium/visitor.hpp>
 
@@ -61,6 +62,33 @@ namespace osmium {
      */
     namespace relations {
 
+        /**
+         * Memory used by a Collector in bytes.
+         */
+        struct CollectorMemoryUsage {
+
+            /// Vector with the RelationMeta objects
+            uint64_t relations = 0;
+
+            /// Vectors with the MemberMeta objects
+            uint64_t members = 0;
+
+            /// Buffer with the relations
+            uint64_t relations_buffer = 0;
+
+            /// Buffer with the members (if kept in main memory)
+            uint64_t members_buffer = 0;
+
+            /// Temporary file with the members (if spilled to disk)
+            uint64_t members_file = 0;
+
+            /// Memory used in main memory (without the temporary file)
+            uint64_t total() const noexcept {
+                return relations + members + relations_buffer + members_buffer;
+            }
+
+        }; // struct CollectorMemoryUsage
+
         /**
          * The Collector class collects members of a relation. This is a generic
          * base class that can be used to assemble all kinds of relations. It has numerous
@@ -168,6 +196,10 @@ namespace osmium {
             // All members we are interested in will be kept in this buffer
             osmium::memory::Buffer m_members_buffer;
 
+            // If set, the memory of m_members_buffer is a memory mapped
+            // temporary file (see spill_members_to_disk())
+            std::unique_ptr<osmium::detail::mmap_vector_file<unsigned char>> m_members_file;
+
             /// Vector with all relations we are interested in
             std::vector<RelationMeta> m_relations;
 
@@ -293,15 +325,19 @@ namespace osmium {
                 );
             }
 
-            const osmium::Relation& get_relation(size_t offset) const {
-                return m_relations_buffer.get<osmium::Relation>(offset);
+            /**
+             * Get the relation at the given position in the m_relations
+             * vector.
+             */
+            const osmium::Relation& get_relation(size_t pos) const {
+                return get_relation(m_relations[pos]);
             }
 
             /**
              * Get the relation from a relation_meta.
              */
             const osmium::Relation& get_relation(const RelationMeta& relation_meta) const {
-                return get_relation(relation_meta.relation_offset());
+                return m_relations_buffer.get<osmium::Relation>(relation_meta.relation_offset());
             }
 
             osmium::OSMObject& get_member(size_t offset) const {
@@ -376,6 +412,7 @@ namespace osmium {
                 }
 
                 {
+                    reserve_member_space(object.padded_size());
                     members_buffer().add_item(object);
                     const size_t member_offset = members_buffer().commit();
 
@@ -400,6 +437,7 @@ namespace osmium {
                         const size_t relation_offset = member_meta.relation_pos();
                         static_cast<TCollector*>(this)->complete_relation(relation_meta);
                         clear_member_metas(relation_meta);
+                        m_relations_buffer.get<osmium::Relation>(relation_meta.relation_offset()).set_removed(true);
                         m_relations[relation_offset] = RelationMeta();
                         possibly_purge_removed_members();
                     }
@@ -439,33 +477,54 @@ namespace osmium {
 
         public:
 
-            uint64_t used_memory() const {
+            /**
+             * Get the memory currently used by the collector.
+             */
+            CollectorMemoryUsage memory_usage() const {
+                CollectorMemoryUsage usage;
                 const uint64_t nmembers = m_member_meta[0].capacity() + m_member_meta[1].capacity() + m_member_meta[2].capacity();
-                const uint64_t members = nmembers * sizeof(MemberMeta);
-                const uint64_t relations = m_relations.capacity() * sizeof(RelationMeta);
-                const uint64_t relations_buffer_capacity = m_relations_buffer.capacity();
-                const uint64_t members_buffer_capacity = m_members_buffer.capacity();
-
-                std::cout << "  nR  = m_relations.capacity() ........... = " << std::setw(12) << m_relations.capacity() << "\n";
-                std::cout << "  nMN = m_member_meta[NODE].capacity() ... = " << std::setw(12) << m_member_meta[0].capacity() << "\n";
-                std::cout << "  nMW = m_member_meta[WAY].capacity() .... = " << std::setw(12) << m_member_meta[1].capacity() << "\n";
-                std::cout << "  nMR = m_member_meta[RELATION].capacity() = " << std::setw(12) << m_member_meta[2].capacity() << "\n";
-                std::cout << "  nM  = m_member_meta[*].capacity() ...... = " << std::setw(12) << nmembers << "\n";
-
-                std::cout << "  sRM = sizeof(RelationMeta) ............. = " << std::setw(12) << sizeof(RelationMeta) << "\n";
-                std::cout << "  sMM = sizeof(MemberMeta) ............... = " << std::setw(12) << sizeof(MemberMeta) << "\n\n";
-
-                std::cout << "  nR * sRM ............................... = " << std::setw(12) << relations << "\n";
-                std::cout << "  nM * sMM ............................... = " << std::setw(12) << members << "\n";
-                std::cout << "  relations_buffer_capacity .............. = " << std::setw(12) << relations_buffer_capacity << "\n";
-                std::cout << "  members_buffer_capacity ................ = " << std::setw(12) << members_buffer_capacity << "\n";
+                usage.relations = m_relations.capacity() * sizeof(RelationMeta);
+                usage.members = nmembers * sizeof(MemberMeta);
+                usage.relations_buffer = m_relations_buffer.capacity();
+                if (m_members_file) {
+                    usage.members_file = m_members_file->capacity();
+                } else {
+                    usage.members_buffer = m_members_buffer.capacity();
+                }
+                return usage;
+            }
 
-                const uint64_t total = relations + members + relations_buffer_capacity + members_buffer_capacity;
+            /**
+             * Get the total memory currently used by the collector (not
+             * counting a temporary file with the members).
+             */
+            uint64_t used_memory() const {
+                return memory_usage().total();
+            }
 
-                std::cout << "  total .................................. = " << std::setw(12) << total << "\n";
-                std::cout << "  =======================================================\n";
+            /**
+             * Keep the member objects in a memory mapped temporary file
+             * instead of main memory. This allows collecting the members of
+             * large files with limited memory. The members already collected
+             * are copied to the file. The file is removed automatically.
+             */
+            void spill_members_to_disk() {
+                if (m_members_file) {
+                    return;
+                }
+                const size_t committed = m_members_buffer.committed();
+                size_t capacity = initial_buffer_size;
+                while (capacity < committed) {
+                    capacity *= 2;
+                }
+                m_members_file.reset(new osmium::detail::mmap_vector_file<unsigned char>());
+                m_members_file->reserve(capacity);
+                std::memcpy(m_members_file->data(), m_members_buffer.data(), committed);
+                m_members_buffer = osmium::memory::Buffer(m_members_file->data(), capacity, committed);
+            }
 
-                return relations_buffer_capacity + members_buffer_capacity + relations + members;
+            bool members_on_disk() const noexcept {
+                return m_members_file != nullptr;
             }
 
             /**
@@ -510,6 +569,76 @@ namespace osmium {
                 }
             }
 
+            /**
+             * Make sure the members buffer has room for size more bytes. A
+             * members buffer in a temporary file has to be grown by hand.
+             */
+            void reserve_member_space(size_t size) {
+                const size_t committed = m_members_buffer.committed();
+                if (!m_members_file || committed + size <= m_members_buffer.capacity()) {
+                    return;
+                }
+                size_t capacity = m_members_buffer.capacity() * 2;
+                while (committed + size > capacity) {
+                    capacity *= 2;
+                }
+                m_members_file->reserve(capacity);
+                m_members_buffer = osmium::memory::Buffer(m_members_file->data(), capacity, committed);
+            }
+
+            /**
+             * Updates the offsets of the relations in m_relations while the
+             * relations buffer is purged.
+             */
+            class RelationOffsetUpdater {
+
+                std::vector<RelationMeta>& m_relations;
+                size_t m_pos = 0;
+
+            public:
+
+                explicit RelationOffsetUpdater(std::vector<RelationMeta>& relations) noexcept :
+                    m_relations(relations) {
+                }
+
+                void moving_in_buffer(size_t old_offset, size_t new_offset) {
+                    // relations are in the same order in the vector and in
+                    // the buffer
+                    while (m_relations[m_pos].relation_offset() != old_offset) {
+                        ++m_pos;
+                    }
+                    m_relations[m_pos].set_relation_offset(new_offset);
+                }
+
+            }; // class RelationOffsetUpdater
+
+            /**
+             * Remove the completed relations from m_relations (like
+             * clean_assembled_relations(), but keeping the positions in the
+             * MemberMetas up to date) and from the relations buffer.
+             */
+            void compact_relations() {
+                std::vector<size_t> new_pos(m_relations.size());
+                size_t pos = 0;
+                for (size_t i = 0; i < m_relations.size(); ++i) {
+                    new_pos[i] = pos;
+                    if (!m_relations[i].has_all_members()) {
+                        ++pos;
+                    }
+                }
+                for (auto& mmv : m_member_meta) {
+                    for (auto& mm : mmv) {
+                        if (!mm.removed()) {
+                            mm.set_relation_pos(new_pos[mm.relation_pos()]);
+                        }
+                    }
+                }
+                clean_assembled_relations();
+
+                RelationOffsetUpdater updater(m_relations);
+                m_relations_buffer.purge_removed(&updater);
+            }
+
             /**
              * Decide whether to purge removed members and then do it.
              *
@@ -521,6 +650,7 @@ namespace osmium {
                 if (m_count_complete > 10000) { // XXX
 //                    const size_t size_before = m_members_buffer.committed();
                     m_members_buffer.purge_removed(this);
+                    compact_relations();
 /*
                     const size_t size_after = m_members_buffer.committed();
                     double percent = static_cast<double>(size_before - size_after);
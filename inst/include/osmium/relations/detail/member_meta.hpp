@@ -99,6 +99,10 @@ namespace osmium {
                 return m_relation_pos;
             }
 
+            void set_relation_pos(size_t pos) noexcept {
+                m_relation_pos = pos;
+            }
+
             size_t member_pos() const noexcept {
                 return m_member_pos;
             }
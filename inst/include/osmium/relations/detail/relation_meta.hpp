@@ -82,6 +82,10 @@ namespace osmium {
                 return m_relation_offset;
             }
 
+            void set_relation_offset(size_t offset) noexcept {
+                m_relation_offset = offset;
+            }
+
             /**
              * Increment the m_need_members counter.
              */
@@ -37,12 +37,15 @@ DEALINGS IN THE SOFTWARE.
 #include <chrono>
 #include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <mutex>
 #include <queue>
 #include <string>
 #include <thread>
 #include <utility> // IWYU pragma: keep (for std::move)
 
+#include <osmium/util/profile.hpp>
+
 namespace osmium {
 
     namespace thread {
@@ -71,7 +74,6 @@ namespace osmium {
 
             std::atomic<bool> m_done;
 
-#ifdef OSMIUM_DEBUG_QUEUE_SIZE
             /// The largest size the queue has been so far.
             size_t m_largest_size;
 
@@ -81,7 +83,12 @@ namespace osmium {
             /// The number of times the queue was full and a thread pushing
             /// to the queue was blocked.
             std::atomic<int> m_full_counter;
-#endif
+
+            /// Sum of the queue sizes after every push() (for the mean size).
+            uint64_t m_size_sum;
+
+            /// Time threads pushing to the queue were blocked.
+            std::atomic<uint64_t> m_blocked_nanoseconds;
 
         public:
 
@@ -98,18 +105,24 @@ namespace osmium {
                 m_mutex(),
                 m_queue(),
                 m_data_available(),
-                m_done(false)
-#ifdef OSMIUM_DEBUG_QUEUE_SIZE
-                ,
+                m_done(false),
                 m_largest_size(0),
                 m_push_counter(0),
-                m_full_counter(0)
-#endif
-            {
+                m_full_counter(0),
+                m_size_sum(0),
+                m_blocked_nanoseconds(0) {
+                // make sure the profile outlives static queues
+                osmium::util::Profile::instance();
             }
 
             ~Queue() {
                 shutdown();
+                try {
+                    osmium::util::Profile::instance().add_queue(m_name, m_max_size, m_push_counter, m_full_counter, m_largest_size, m_size_sum,
+                                                                static_cast<double>(m_blocked_nanoseconds) / 1e9);
+                } catch (...) {
+                    // ignore: statistics are not worth an exception in a destructor
+                }
 #ifdef OSMIUM_DEBUG_QUEUE_SIZE
                 std::cerr << "queue '" << m_name << "' with max_size=" << m_max_size << " had largest size " << m_largest_size << " and was full " << m_full_counter << " times in " << m_push_counter << " push() calls\n";
 #endif
@@ -120,24 +133,21 @@ namespace osmium {
              * call will block if the queue is full.
              */
             void push(T value) {
-#ifdef OSMIUM_DEBUG_QUEUE_SIZE
                 ++m_push_counter;
-#endif
-                if (m_max_size) {
+                if (m_max_size && size() >= m_max_size) {
+                    const auto start = std::chrono::steady_clock::now();
                     while (size() >= m_max_size) {
                         std::this_thread::sleep_for(full_queue_sleep_duration);
-#ifdef OSMIUM_DEBUG_QUEUE_SIZE
                         ++m_full_counter;
-#endif
                     }
+                    m_blocked_nanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
                 }
                 std::lock_guard<std::mutex> lock(m_mutex);
                 m_queue.push(std::move(value));
-#ifdef OSMIUM_DEBUG_QUEUE_SIZE
                 if (m_largest_size < m_queue.size()) {
                     m_largest_size = m_queue.size();
                 }
-#endif
+                m_size_sum += m_queue.size();
                 m_data_available.notify_one();
             }
 
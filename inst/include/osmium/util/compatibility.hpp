@@ -50,4 +50,11 @@ DEALINGS IN THE SOFTWARE.
 # define OSMIUM_DEPRECATED
 #endif
 
+// Hint to load the memory at the address into the cache (for reading)
+#if defined(__GNUC__) || defined(__clang__)
+# define OSMIUM_PREFETCH(address) __builtin_prefetch(address)
+#else
+# define OSMIUM_PREFETCH(address)
+#endif
+
 #endif // OSMIUM_UTIL_COMPATIBILITY_HPP
@@ -0,0 +1,294 @@
+#ifndef OSMIUM_UTIL_PROFILE_HPP
+#define OSMIUM_UTIL_PROFILE_HPP
+
+/*
+
+This file is part of Osmium (http://osmcode.org/libosmium).
+
+Copyright 2013-2015 Jochen Topf <jochen@topf.org> and others (see README).
+
+Boost Software License - Version 1.0 - August 17th, 2003
+
+Permission is hereby granted, free of charge, to any person or organization
+obtaining a copy of the software and accompanying documentation covered by
+this license (the "Software") to use, reproduce, display, distribute,
+execute, and transmit the Software, and to prepare derivative works of the
+Software, and to permit third-parties to whom the Software is furnished to
+do so, all subject to the following:
+
+The copyright notices in the Software and this entire statement, including
+the above license grant, this restriction and the following disclaimer,
+must be included in all copies of the Software, in whole or in part, and
+all derivative works of the Software, unless such copies or derivative
+works are solely in the form of machine-executable object code generated by
+a source language processor.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace osmium {
+
+    namespace util {
+
+        /**
+         * Opt-in collection of timings and counters of the stages of the
+         * reading and writing pipelines (reading input, decoding, parsing,
+         * queues, encoding, writing, ...). Stages are identified by name
+         * and can be updated from any thread.
+         *
+         * Profiling is disabled by default. While it is disabled, stage()
+         * returns nullptr and the instrumented code only pays for one
+         * atomic load per stage.
+         */
+        class Profile {
+
+        public:
+
+            class Stage {
+
+                std::atomic<uint64_t> m_nanoseconds;
+                std::atomic<uint64_t> m_calls;
+                std::atomic<uint64_t> m_items;
+                std::atomic<uint64_t> m_bytes;
+
+            public:
+
+                Stage() :
+                    m_nanoseconds(0),
+                    m_calls(0),
+                    m_items(0),
+                    m_bytes(0) {
+                }
+
+                void add(std::chrono::steady_clock::duration duration, uint64_t items, uint64_t bytes) noexcept {
+                    m_nanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+                    ++m_calls;
+                    m_items += items;
+                    m_bytes += bytes;
+                }
+
+                void reset() noexcept {
+                    m_nanoseconds = 0;
+                    m_calls = 0;
+                    m_items = 0;
+                    m_bytes = 0;
+                }
+
+                double seconds() const noexcept {
+                    return static_cast<double>(m_nanoseconds) / 1e9;
+                }
+
+                uint64_t calls() const noexcept {
+                    return m_calls;
+                }
+
+                uint64_t items() const noexcept {
+                    return m_items;
+                }
+
+                uint64_t bytes() const noexcept {
+                    return m_bytes;
+                }
+
+            }; // class Stage
+
+            /**
+             * Statistics of all queues with the same name.
+             */
+            struct QueueStats {
+                uint64_t queues = 0;
+                size_t max_size = 0;
+                uint64_t pushes = 0;
+                uint64_t full = 0;
+                size_t largest_size = 0;
+                uint64_t size_sum = 0;
+                double blocked_seconds = 0.0;
+
+                /// Average number of elements in the queue after a push.
+                double mean_size() const noexcept {
+                    return pushes == 0 ? 0.0 : static_cast<double>(size_sum) / static_cast<double>(pushes);
+                }
+            };
+
+        private:
+
+            std::atomic<bool> m_enabled;
+
+            mutable std::mutex m_mutex;
+
+            // Stages are never removed, so pointers to them stay valid.
+            std::map<std::string, std::unique_ptr<Stage>> m_stages;
+
+            std::map<std::string, QueueStats> m_queues;
+
+            Profile() :
+                m_enabled(false) {
+            }
+
+        public:
+
+            static Profile& instance() {
+                static Profile profile;
+                return profile;
+            }
+
+            bool enabled() const noexcept {
+                return m_enabled.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Enable or disable profiling. Objects which have resolved a
+             * stage before keep recording into it.
+             */
+            void enable(bool enabled = true) noexcept {
+                m_enabled = enabled;
+            }
+
+            /**
+             * Set all stages to zero and remove the queue statistics.
+             */
+            void reset() {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto& stage : m_stages) {
+                    stage.second->reset();
+                }
+                m_queues.clear();
+            }
+
+            /**
+             * The stage with the given name, created if necessary. Returns
+             * nullptr if profiling is disabled.
+             */
+            Stage* stage(const std::string& name) {
+                if (!enabled()) {
+                    return nullptr;
+                }
+                std::lock_guard<std::mutex> lock(m_mutex);
+                std::unique_ptr<Stage>& stage = m_stages[name];
+                if (!stage) {
+                    stage.reset(new Stage());
+                }
+                return stage.get();
+            }
+
+            /**
+             * Add the statistics of one queue. Usually called when the queue
+             * is destroyed.
+             */
+            void add_queue(const std::string& name, size_t max_size, uint64_t pushes, uint64_t full, size_t largest_size, uint64_t size_sum, double blocked_seconds) {
+                if (!enabled()) {
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(m_mutex);
+                QueueStats& stats = m_queues[name];
+                ++stats.queues;
+                stats.max_size = std::max(stats.max_size, max_size);
+                stats.pushes += pushes;
+                stats.full += full;
+                stats.largest_size = std::max(stats.largest_size, largest_size);
+                stats.size_sum += size_sum;
+                stats.blocked_seconds += blocked_seconds;
+            }
+
+            /**
+             * Call func(name, stage) for all stages used since the last
+             * reset() in the order of their names.
+             */
+            template <typename TFunc>
+            void for_each_stage(TFunc&& func) const {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (const auto& stage : m_stages) {
+                    if (stage.second->calls() > 0) {
+                        func(stage.first, *stage.second);
+                    }
+                }
+            }
+
+            /**
+             * Call func(name, stats) for all queues in the order of their
+             * names.
+             */
+            template <typename TFunc>
+            void for_each_queue(TFunc&& func) const {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (const auto& queue : m_queues) {
+                    func(queue.first, queue.second);
+                }
+            }
+
+        }; // class Profile
+
+        /**
+         * Adds the time from construction to destruction to a stage. Does
+         * nothing if the stage is nullptr (profiling disabled).
+         */
+        class ProfileTimer {
+
+            Profile::Stage* m_stage;
+            std::chrono::steady_clock::time_point m_start;
+            uint64_t m_items;
+            uint64_t m_bytes;
+
+        public:
+
+            explicit ProfileTimer(Profile::Stage* stage) noexcept :
+                m_stage(stage),
+                m_start(),
+                m_items(0),
+                m_bytes(0) {
+                if (m_stage) {
+                    m_start = std::chrono::steady_clock::now();
+                }
+            }
+
+            explicit ProfileTimer(const char* name) :
+                ProfileTimer(Profile::instance().stage(name)) {
+            }
+
+            ProfileTimer(const ProfileTimer&) = delete;
+            ProfileTimer& operator=(const ProfileTimer&) = delete;
+
+            ~ProfileTimer() noexcept {
+                if (m_stage) {
+                    m_stage->add(std::chrono::steady_clock::now() - m_start, m_items, m_bytes);
+                }
+            }
+
+            /// Is the time recorded?
+            bool active() const noexcept {
+                return m_stage != nullptr;
+            }
+
+            void add_items(uint64_t items) noexcept {
+                m_items += items;
+            }
+
+            void add_bytes(uint64_t bytes) noexcept {
+                m_bytes += bytes;
+            }
+
+        }; // class ProfileTimer
+
+    } // namespace util
+
+} // namespace osmium
+
+#endif // OSMIUM_UTIL_PROFILE_HPP
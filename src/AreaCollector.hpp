@@ -0,0 +1,300 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef AREACOLLECTOR_HPP
+#define AREACOLLECTOR_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+#include <osmium/handler.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/way.hpp>
+#include <osmium/relations/collector.hpp>
+#include <osmium/thread/pool.hpp>
+#include <osmium/util/profile.hpp>
+
+namespace areacollector {
+
+// Relations and closed ways copied together with their member ways. The areas
+// are assembled on a pool thread in the order the entries were added.
+template <typename TAssembler>
+class AreaJob {
+public:
+  typedef typename TAssembler::config_type assembler_config_type;
+
+  AreaJob(const assembler_config_type& config) :
+    mConfig(config),
+    mInput(std::make_shared<osmium::memory::Buffer>(1024 * 1024, osmium::memory::Buffer::auto_grow::yes)),
+    mEntries(std::make_shared<std::vector<Entry>>()) {
+  }
+
+  void addWay(const osmium::Way& way) {
+    mEntries->push_back(Entry { add(way), {} });
+  }
+
+  void addRelation(const osmium::Relation& relation, const osmium::memory::Buffer& members_buffer, const std::vector<size_t>& offsets) {
+    Entry entry { add(relation), {} };
+    entry.members.reserve(offsets.size());
+    for(size_t offset : offsets) {
+      entry.members.push_back(add(members_buffer.get<const osmium::Way>(offset)));
+    }
+    mEntries->push_back(std::move(entry));
+  }
+
+  size_t size() const {
+    return mInput->committed();
+  }
+
+  bool empty() const {
+    return mEntries->empty();
+  }
+
+  osmium::memory::Buffer operator()() {
+    osmium::memory::Buffer output(1024 * 1024, osmium::memory::Buffer::auto_grow::yes);
+    // the assembler keeps its memory from one area to the next
+    TAssembler assembler(mConfig);
+    osmium::util::ProfileTimer timer("area_assembly");
+    timer.add_items(mEntries->size());
+    for(const Entry& entry : *mEntries) {
+      try {
+        const osmium::OSMObject& obj = mInput->get<const osmium::OSMObject>(entry.offset);
+        if(obj.type() == osmium::item_type::way) {
+          assembler(static_cast<const osmium::Way&>(obj), output);
+        } else {
+          assembler(static_cast<const osmium::Relation&>(obj), entry.members, *mInput, output);
+        }
+      } catch(osmium::invalid_location&) {
+        // ignored like in osmium::area::MultipolygonCollector
+      }
+    }
+    return output;
+  }
+
+private:
+  struct Entry {
+    size_t offset;
+    std::vector<size_t> members;
+  };
+
+  size_t add(const osmium::memory::Item& item) {
+    size_t offset = mInput->committed();
+    mInput->add_item(item);
+    mInput->commit();
+    return offset;
+  }
+
+  assembler_config_type mConfig;
+  std::shared_ptr<osmium::memory::Buffer> mInput;
+  std::shared_ptr<std::vector<Entry>> mEntries;
+};
+
+typedef std::function<void(osmium::memory::Buffer&&)> area_callback_type;
+
+// Whether an area is assembled from the way on its own
+typedef std::function<bool(const osmium::Way&)> way_predicate_type;
+
+// Whether the way can be assembled to an area on its own
+inline bool isClosedRing(const osmium::Way& way) {
+  // at least 4 nodes are needed for a closed ring
+  if(way.nodes().size() <= 3) {
+    return false;
+  }
+  return way.nodes().front().location() && way.nodes().back().location() && way.ends_have_same_location();
+}
+
+// Collects the objects into jobs which are assembled on the osmium thread
+// pool. The area buffers are passed to the callback in the order the objects
+// were added.
+template <typename TAssembler>
+class AreaPipeline {
+public:
+  typedef typename TAssembler::config_type assembler_config_type;
+  typedef AreaJob<TAssembler> job_type;
+
+  static const size_t max_job_size = 1024 * 1024;
+  static const size_t max_pending = 16;
+
+  explicit AreaPipeline(const assembler_config_type& config) :
+    mConfig(config),
+    mJob(config) {
+  }
+
+  void addWay(const osmium::Way& way, const area_callback_type& callback) {
+    mJob.addWay(way);
+    possiblySubmitJob(callback);
+  }
+
+  void addRelation(const osmium::Relation& relation, const osmium::memory::Buffer& members_buffer,
+                   const std::vector<size_t>& offsets, const area_callback_type& callback) {
+    mJob.addRelation(relation, members_buffer, offsets);
+    possiblySubmitJob(callback);
+  }
+
+  void flush(const area_callback_type& callback) {
+    submitJob(callback);
+    deliver(true, callback);
+  }
+
+private:
+
+  void submitJob(const area_callback_type& callback) {
+    if(mJob.empty()) {
+      return;
+    }
+    mPending.push_back(osmium::thread::Pool::instance().submit(std::move(mJob)));
+    mJob = job_type(mConfig);
+    deliver(false, callback);
+  }
+
+  // Passes the finished jobs to the callback. Waits for the oldest job if too
+  // many are pending or if all jobs have to be delivered.
+  void deliver(bool all, const area_callback_type& callback) {
+    while(!mPending.empty()) {
+      bool ready = mPending.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+      if(!ready && !all && mPending.size() <= max_pending) {
+        return;
+      }
+      osmium::memory::Buffer buffer = mPending.front().get();
+      mPending.pop_front();
+      if(callback && buffer.committed() > 0) {
+        callback(std::move(buffer));
+      }
+    }
+  }
+
+  void possiblySubmitJob(const area_callback_type& callback) {
+    if(mJob.size() > max_job_size) {
+      submitJob(callback);
+    }
+  }
+
+  const assembler_config_type mConfig;
+  job_type mJob;
+  std::deque<std::future<osmium::memory::Buffer>> mPending;
+};
+
+} // namespace areacollector
+
+// Collects multipolygon relations like osmium::area::MultipolygonCollector, but
+// assembles the areas on the osmium thread pool. The area buffers are passed
+// to the callback on the reading thread in the same order the sequential
+// collector would create them. Closed ways which aren't members of any
+// multipolygon are only assembled if with_ways is set.
+template <typename TAssembler>
+class ParallelMultipolygonCollector : public osmium::relations::Collector<ParallelMultipolygonCollector<TAssembler>, false, true, false> {
+
+  typedef osmium::relations::Collector<ParallelMultipolygonCollector<TAssembler>, false, true, false> collector_type;
+  typedef typename TAssembler::config_type assembler_config_type;
+
+  areacollector::AreaPipeline<TAssembler> mPipeline;
+  bool mWithWays;
+
+public:
+
+  explicit ParallelMultipolygonCollector(const assembler_config_type& config, bool with_ways = true) :
+    collector_type(),
+    mPipeline(config),
+    mWithWays(with_ways) {
+  }
+
+  bool keep_relation(const osmium::Relation& relation) const {
+    const char* type = relation.tags().get_value_by_key("type");
+    return type != nullptr && (!std::strcmp(type, "multipolygon") || !std::strcmp(type, "boundary"));
+  }
+
+  bool keep_member(const osmium::relations::RelationMeta&, const osmium::RelationMember& member) const {
+    return member.type() == osmium::item_type::way;
+  }
+
+  // Whether an area is assembled from the way on its own, i.e. it is a closed
+  // ring which isn't a member of any multipolygon. Has to be called before
+  // the way is passed to the handler of the collector.
+  bool assemblesWay(const osmium::Way& way) {
+    if(!mWithWays || !areacollector::isClosedRing(way)) {
+      return false;
+    }
+    auto& members = this->member_meta(osmium::item_type::way);
+    auto range = std::equal_range(members.begin(), members.end(), osmium::relations::MemberMeta(way.id()));
+    return osmium::relations::count_not_removed(range.first, range.second) == 0;
+  }
+
+  void way_not_in_any_relation(const osmium::Way& way) {
+    if(mWithWays && areacollector::isClosedRing(way)) {
+      mPipeline.addWay(way, this->callback());
+    }
+  }
+
+  void complete_relation(osmium::relations::RelationMeta& relation_meta) {
+    const osmium::Relation& relation = this->get_relation(relation_meta);
+    std::vector<size_t> offsets;
+    for(const auto& member : relation.members()) {
+      if(member.ref() != 0) {
+        offsets.push_back(this->get_offset(member.type(), member.ref()));
+      }
+    }
+    mPipeline.addRelation(relation, this->members_buffer(), offsets, this->callback());
+  }
+
+  void flush() {
+    mPipeline.flush(this->callback());
+  }
+};
+
+// Assembles areas from all closed ways while streaming through the file.
+// Needs no pass over the relations, but doesn't know whether a way is a
+// member of a multipolygon (such ways are assembled on their own too).
+template <typename TAssembler>
+class ClosedWayAreaHandler : public osmium::handler::Handler {
+
+  typedef typename TAssembler::config_type assembler_config_type;
+
+  areacollector::AreaPipeline<TAssembler> mPipeline;
+  areacollector::area_callback_type mCallback;
+
+public:
+
+  ClosedWayAreaHandler(const assembler_config_type& config, areacollector::area_callback_type callback) :
+    mPipeline(config),
+    mCallback(callback) {
+  }
+
+  bool assemblesWay(const osmium::Way& way) const {
+    return areacollector::isClosedRing(way);
+  }
+
+  void way(const osmium::Way& way) {
+    if(assemblesWay(way)) {
+      mPipeline.addWay(way, mCallback);
+    }
+  }
+
+  void flush() {
+    mPipeline.flush(mCallback);
+  }
+};
+
+#endif // AREACOLLECTOR_HPP
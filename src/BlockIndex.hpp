@@ -0,0 +1,439 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BLOCKINDEX_HPP
+#define BLOCKINDEX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <protozero/pbf_message.hpp>
+#include <osmium/io/detail/pbf.hpp>
+#include <osmium/io/detail/pbf_decoder.hpp>
+#include <osmium/io/detail/protobuf_tags.hpp>
+#include <osmium/io/file.hpp>
+#include <osmium/io/input_iterator.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/thread/pool.hpp>
+
+// Index slots for the per entity type id ranges of a blob
+enum BlockIndexSlot {
+  slot_node = 0,
+  slot_way = 1,
+  slot_relation = 2
+};
+
+inline int blockIndexSlot(osmium::item_type type) {
+  switch(type) {
+  case osmium::item_type::node:
+    return slot_node;
+  case osmium::item_type::way:
+    return slot_way;
+  case osmium::item_type::relation:
+    return slot_relation;
+  default:
+    return -1;
+  }
+}
+
+// Summary of one OSMData blob of a PBF file. The bounding box covers the
+// nodes of the blob only (ways and relations have no locations in PBF).
+struct BlockIndexEntry {
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  osmium::osm_entity_bits::type types = osmium::osm_entity_bits::nothing;
+  osmium::object_id_type minId[3] = { std::numeric_limits<osmium::object_id_type>::max(),
+                                      std::numeric_limits<osmium::object_id_type>::max(),
+                                      std::numeric_limits<osmium::object_id_type>::max() };
+  osmium::object_id_type maxId[3] = { std::numeric_limits<osmium::object_id_type>::min(),
+                                      std::numeric_limits<osmium::object_id_type>::min(),
+                                      std::numeric_limits<osmium::object_id_type>::min() };
+  osmium::Box box;
+
+  void add(const osmium::OSMObject& obj) {
+    int slot = blockIndexSlot(obj.type());
+    if(slot < 0) {
+      return;
+    }
+    types |= osmium::osm_entity_bits::from_item_type(obj.type());
+    minId[slot] = std::min(minId[slot], obj.id());
+    maxId[slot] = std::max(maxId[slot], obj.id());
+    if(obj.type() == osmium::item_type::node) {
+      const osmium::Location& loc = static_cast<const osmium::Node&>(obj).location();
+      if(loc.valid()) {
+        box.extend(loc);
+      }
+    }
+  }
+};
+
+// Describes which blobs a reader has to decode. Empty id vectors and an
+// invalid box mean "no restriction".
+struct BlockSelection {
+  osmium::Box box;
+  std::vector<osmium::object_id_type> ids[3];
+
+  bool empty() const {
+    return !box.valid() && ids[slot_node].empty() && ids[slot_way].empty() && ids[slot_relation].empty();
+  }
+
+  void addIds(const std::vector<osmium::object_id_type>& new_ids, osmium::item_type type) {
+    int slot = blockIndexSlot(type);
+    if(slot < 0) {
+      throw std::invalid_argument("ids can only be selected for nodes, ways and relations");
+    }
+    std::vector<osmium::object_id_type>& v = ids[slot];
+    v.insert(v.end(), new_ids.begin(), new_ids.end());
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+  }
+
+  void clear() {
+    box = osmium::Box();
+    for(auto& v : ids) {
+      v.clear();
+    }
+  }
+
+  // Whether the blob may contain objects of the requested types matching the
+  // selection. If all_nodes is set, node blobs are never skipped (needed if
+  // node locations for ways are required).
+  bool matches(const BlockIndexEntry& entry, osmium::osm_entity_bits::type read_types, bool all_nodes) const {
+    if(!(entry.types & read_types)) {
+      return false;
+    }
+    if(empty() || (all_nodes && (entry.types & osmium::osm_entity_bits::node))) {
+      return true;
+    }
+    bool id_selection = false;
+    for(int slot = slot_node; slot <= slot_relation; ++slot) {
+      if(ids[slot].empty()) {
+        continue;
+      }
+      id_selection = true;
+      auto it = std::lower_bound(ids[slot].begin(), ids[slot].end(), entry.minId[slot]);
+      if(it != ids[slot].end() && *it <= entry.maxId[slot]) {
+        return true;
+      }
+    }
+    if(id_selection) {
+      return false;
+    }
+    // bounding box selection: only node blobs can be skipped, ways and
+    // relations are related to the box through their members
+    if(!(entry.types & osmium::osm_entity_bits::node)) {
+      return true;
+    }
+    if(entry.types & ~osmium::osm_entity_bits::node & read_types) {
+      return true;
+    }
+    return entry.box.valid() &&
+           entry.box.bottom_left().x() <= box.top_right().x() && entry.box.top_right().x() >= box.bottom_left().x() &&
+           entry.box.bottom_left().y() <= box.top_right().y() && entry.box.top_right().y() >= box.bottom_left().y();
+  }
+};
+
+namespace blockindex {
+
+const char magic[8] = { 'R', 'O', 'S', 'M', 'B', 'I', 'X', '1' };
+
+// Number of blobs decoded ahead of the consumer
+const size_t max_pending = 16;
+
+// Reads the blob starting at offset. Returns the size of the complete blob
+// (size field, BlobHeader and Blob) or 0 at the end of the file. The blob
+// data (without BlobHeader) is stored in blob, the type in type.
+inline uint64_t readBlob(std::ifstream& in, uint64_t offset, std::string& type, std::string& blob) {
+  in.seekg(offset);
+  uint32_t size_in_network_byte_order;
+  if(!in.read(reinterpret_cast<char*>(&size_in_network_byte_order), sizeof(size_in_network_byte_order))) {
+    in.clear();
+    return 0;
+  }
+  const uint32_t header_size = ntohl(size_in_network_byte_order);
+  if(header_size > static_cast<uint32_t>(osmium::io::detail::max_blob_header_size)) {
+    throw osmium::pbf_error("invalid BlobHeader size (> max_blob_header_size)");
+  }
+  std::string header(header_size, '\0');
+  if(!in.read(&header[0], header_size)) {
+    throw osmium::pbf_error("truncated data (EOF encountered)");
+  }
+  uint64_t datasize = 0;
+  protozero::pbf_message<osmium::io::detail::FileFormat::BlobHeader> pbf_blob_header(header);
+  while(pbf_blob_header.next()) {
+    switch(pbf_blob_header.tag()) {
+    case osmium::io::detail::FileFormat::BlobHeader::required_string_type:
+      type = pbf_blob_header.get_string();
+      break;
+    case osmium::io::detail::FileFormat::BlobHeader::required_int32_datasize:
+      datasize = pbf_blob_header.get_int32();
+      break;
+    default:
+      pbf_blob_header.skip();
+    }
+  }
+  if(datasize == 0 || datasize > osmium::io::detail::max_uncompressed_blob_size) {
+    throw osmium::pbf_error("invalid blob size");
+  }
+  blob.resize(datasize);
+  if(!in.read(&blob[0], datasize)) {
+    throw osmium::pbf_error("truncated data (EOF encountered)");
+  }
+  return sizeof(size_in_network_byte_order) + header_size + datasize;
+}
+
+template <typename T>
+inline void write(std::ofstream& out, const T& val) {
+  out.write(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+template <typename T>
+inline void read(std::ifstream& in, T& val) {
+  if(!in.read(reinterpret_cast<char*>(&val), sizeof(T))) {
+    throw std::runtime_error("block index file is truncated");
+  }
+}
+
+inline uint64_t fileSize(const std::string& filename) {
+  std::ifstream in(filename, std::ios::binary | std::ios::ate);
+  if(!in) {
+    throw std::runtime_error("unable to open file '" + filename + "'");
+  }
+  return static_cast<uint64_t>(in.tellg());
+}
+
+} // namespace blockindex
+
+// Sidecar index of a PBF file: one entry per OSMData blob with its file
+// offset, the contained entity types, id ranges and the bounding box of the
+// nodes. The entries are shared between copies.
+class BlockIndex {
+public:
+
+  BlockIndex(std::string filename) : mFilename(filename) {
+    mEntries = std::make_shared<std::vector<BlockIndexEntry>>();
+  }
+
+  std::string getFilename() {
+    return mFilename;
+  }
+
+  int size() {
+    return mEntries->size();
+  }
+
+  const std::vector<BlockIndexEntry>& entries() const {
+    return *mEntries;
+  }
+
+  // Scans the whole file once and decodes the blobs on the osmium pool
+  void build() {
+    std::ifstream in(mFilename, std::ios::binary);
+    if(!in) {
+      throw std::runtime_error("unable to open file '" + mFilename + "'");
+    }
+    auto entries = std::make_shared<std::vector<BlockIndexEntry>>();
+    std::deque<std::future<osmium::memory::Buffer>> pending;
+    std::string type;
+    std::string blob;
+    uint64_t offset = 0;
+    while(uint64_t size = blockindex::readBlob(in, offset, type, blob)) {
+      if(type == "OSMData") {
+        BlockIndexEntry entry;
+        entry.offset = offset;
+        entry.size = size;
+        entries->push_back(entry);
+        osmium::io::detail::PBFDataBlobDecoder decoder(std::move(blob), osmium::osm_entity_bits::nwr);
+        pending.push_back(osmium::thread::Pool::instance().submit(std::move(decoder)));
+        if(pending.size() > blockindex::max_pending) {
+          summarize(pending, *entries);
+        }
+      } else if(type != "OSMHeader") {
+        throw osmium::pbf_error("unknown blob type '" + type + "'");
+      }
+      offset += size;
+    }
+    while(!pending.empty()) {
+      summarize(pending, *entries);
+    }
+    mEntries = entries;
+    mFileSize = offset;
+  }
+
+  void save(std::string idx_file) {
+    std::ofstream out(idx_file, std::ios::binary | std::ios::trunc);
+    if(!out) {
+      throw std::runtime_error("unable to open index file '" + idx_file + "' for writing");
+    }
+    out.write(blockindex::magic, sizeof(blockindex::magic));
+    blockindex::write(out, mFileSize);
+    blockindex::write(out, static_cast<uint64_t>(mEntries->size()));
+    for(const BlockIndexEntry& entry : *mEntries) {
+      blockindex::write(out, entry.offset);
+      blockindex::write(out, entry.size);
+      blockindex::write(out, static_cast<uint8_t>(entry.types));
+      for(int slot = slot_node; slot <= slot_relation; ++slot) {
+        blockindex::write(out, entry.minId[slot]);
+        blockindex::write(out, entry.maxId[slot]);
+      }
+      blockindex::write(out, entry.box.bottom_left().x());
+      blockindex::write(out, entry.box.bottom_left().y());
+      blockindex::write(out, entry.box.top_right().x());
+      blockindex::write(out, entry.box.top_right().y());
+    }
+    if(!out) {
+      throw std::runtime_error("error while writing index file '" + idx_file + "'");
+    }
+  }
+
+  void load(std::string idx_file) {
+    std::ifstream in(idx_file, std::ios::binary);
+    if(!in) {
+      throw std::runtime_error("unable to open index file '" + idx_file + "'");
+    }
+    char magic[sizeof(blockindex::magic)];
+    if(!in.read(magic, sizeof(magic)) || std::memcmp(magic, blockindex::magic, sizeof(magic))) {
+      throw std::runtime_error("'" + idx_file + "' is not a block index file");
+    }
+    uint64_t file_size;
+    uint64_t count;
+    blockindex::read(in, file_size);
+    blockindex::read(in, count);
+    if(file_size != blockindex::fileSize(mFilename)) {
+      throw std::runtime_error("block index '" + idx_file + "' is out of date, rebuild it");
+    }
+    auto entries = std::make_shared<std::vector<BlockIndexEntry>>(count);
+    for(BlockIndexEntry& entry : *entries) {
+      uint8_t types;
+      int32_t x1, y1, x2, y2;
+      blockindex::read(in, entry.offset);
+      blockindex::read(in, entry.size);
+      blockindex::read(in, types);
+      entry.types = static_cast<osmium::osm_entity_bits::type>(types);
+      for(int slot = slot_node; slot <= slot_relation; ++slot) {
+        blockindex::read(in, entry.minId[slot]);
+        blockindex::read(in, entry.maxId[slot]);
+      }
+      blockindex::read(in, x1);
+      blockindex::read(in, y1);
+      blockindex::read(in, x2);
+      blockindex::read(in, y2);
+      entry.box = osmium::Box(osmium::Location(x1, y1), osmium::Location(x2, y2));
+    }
+    mEntries = entries;
+    mFileSize = file_size;
+  }
+
+  std::vector<BlockIndexEntry> select(const BlockSelection& selection, osmium::osm_entity_bits::type read_types, bool all_nodes) const {
+    std::vector<BlockIndexEntry> ret;
+    for(const BlockIndexEntry& entry : *mEntries) {
+      if(selection.matches(entry, read_types, all_nodes)) {
+        ret.push_back(entry);
+      }
+    }
+    return ret;
+  }
+
+private:
+
+  void summarize(std::deque<std::future<osmium::memory::Buffer>>& pending, std::vector<BlockIndexEntry>& entries) {
+    BlockIndexEntry& entry = entries[entries.size() - pending.size()];
+    osmium::memory::Buffer buffer = pending.front().get();
+    pending.pop_front();
+    for(auto it = buffer.cbegin<osmium::OSMObject>(); it != buffer.cend<osmium::OSMObject>(); ++it) {
+      entry.add(*it);
+    }
+  }
+
+  std::string mFilename;
+  uint64_t mFileSize = 0;
+  std::shared_ptr<std::vector<BlockIndexEntry>> mEntries;
+};
+
+// Reads only the given blobs of a PBF file. The blobs are decoded on the
+// osmium pool and returned in file order. Can be used like an
+// osmium::io::Reader with osmium::apply.
+class IndexedReader {
+public:
+
+  // Tags and objects not needed according to the options are dropped (see
+  // osmium::io::File)
+  IndexedReader(const std::string& filename, std::vector<BlockIndexEntry> entries, osmium::osm_entity_bits::type read_types,
+                const osmium::io::detail::decode_options& options = osmium::io::detail::decode_options()) :
+    mIn(filename, std::ios::binary), mEntries(std::move(entries)), mReadTypes(read_types), mOptions(options) {
+    if(!mIn) {
+      throw std::runtime_error("unable to open file '" + filename + "'");
+    }
+  }
+
+  osmium::memory::Buffer read() {
+    while(mPending.size() < blockindex::max_pending && mNext < mEntries.size()) {
+      std::string type;
+      std::string blob;
+      blockindex::readBlob(mIn, mEntries[mNext++].offset, type, blob);
+      if(type != "OSMData") {
+        throw osmium::pbf_error("block index does not match file (expected OSMData blob)");
+      }
+      osmium::io::detail::PBFDataBlobDecoder decoder(std::move(blob), mReadTypes, mOptions);
+      mPending.push_back(osmium::thread::Pool::instance().submit(std::move(decoder)));
+    }
+    if(mPending.empty()) {
+      return osmium::memory::Buffer();
+    }
+    osmium::memory::Buffer buffer = mPending.front().get();
+    mPending.pop_front();
+    return buffer;
+  }
+
+  void close() {
+    mPending.clear();
+    mIn.close();
+  }
+
+  osmium::io::InputIterator<IndexedReader> begin() {
+    return osmium::io::InputIterator<IndexedReader>(*this);
+  }
+
+  osmium::io::InputIterator<IndexedReader> end() {
+    return osmium::io::InputIterator<IndexedReader>();
+  }
+
+private:
+  std::ifstream mIn;
+  std::vector<BlockIndexEntry> mEntries;
+  osmium::osm_entity_bits::type mReadTypes;
+  osmium::io::detail::decode_options mOptions;
+  size_t mNext = 0;
+  std::deque<std::future<osmium::memory::Buffer>> mPending;
+};
+
+#endif // BLOCKINDEX_HPP
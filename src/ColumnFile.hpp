@@ -0,0 +1,436 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef COLUMNFILE_HPP
+#define COLUMNFILE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/util/memory_mapping.hpp>
+
+#include "BlockIndex.hpp"
+
+namespace columnfile {
+
+const char magic[8] = { 'R', 'O', 'S', 'M', 'C', 'O', 'L', '1' };
+
+// Storage of the values of a column in a chunk. Strings are stored as codes
+// into a dictionary of the column, blobs as row offsets followed by the bytes.
+enum ColumnType {
+  col_int64 = 0,
+  col_double = 1,
+  col_dict = 2,
+  col_blob = 3
+};
+
+// Rows per chunk
+enum { chunk_rows = 65536 };
+
+// Missing dictionary code (1-based codes), equal to NA_integer_ of R
+const int32_t na_code = INT32_MIN;
+
+// NA_real_ of R (a NaN with the payload 1954), so double columns can be
+// copied as they are
+inline double naReal() {
+  const uint64_t bits = 0x7FF00000000007A2ULL;
+  double ret;
+  std::memcpy(&ret, &bits, sizeof(ret));
+  return ret;
+}
+
+struct Column {
+  std::string name;
+  ColumnType type;
+  std::vector<std::string> levels;
+};
+
+// Position of the values of a column in a chunk
+struct Extent {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct Chunk {
+  uint64_t rows;
+  std::vector<Extent> extents;
+};
+
+// Values of the column types, one per row
+inline uint64_t valueSize(ColumnType type) {
+  return type == col_dict ? sizeof(int32_t) : sizeof(int64_t);
+}
+
+inline void writeString(std::ofstream& out, const std::string& str) {
+  blockindex::write(out, static_cast<uint32_t>(str.size()));
+  out.write(str.data(), str.size());
+}
+
+} // namespace columnfile
+
+// Writes OSM objects as rows of a column file: the type (node, way, relation
+// or area) and id, the location of nodes, one column per tag key and
+// optionally the geometry as WKB. The rows are collected in chunks; the
+// values of every column are stored contiguously in a chunk and aligned to
+// 8 bytes, so the file can be memory mapped and copied into R vectors.
+//
+// Layout: magic, chunk data, footer (columns with their types and
+// dictionaries, rows and column extents of every chunk), offset of the
+// footer and magic again. All numbers are stored in native byte order.
+class ColumnFileWriter {
+public:
+  ColumnFileWriter(const std::string& filename, const std::vector<std::string>& keys, bool with_geometry, bool overwrite) :
+    mFilename(filename), mKeys(keys), mWithGeometry(with_geometry) {
+    if(!overwrite && std::ifstream(filename)) {
+      throw std::runtime_error("file '" + filename + "' exists already");
+    }
+    mOut.open(filename, std::ios::binary | std::ios::trunc);
+    if(!mOut) {
+      throw std::runtime_error("unable to open file '" + filename + "' for writing");
+    }
+    mOut.write(columnfile::magic, sizeof(columnfile::magic));
+    mColumns.push_back(columnfile::Column{"osm_type", columnfile::col_dict, {"node", "way", "relation", "area_way", "area_relation"}});
+    mColumns.push_back(columnfile::Column{"osm_id", columnfile::col_int64, {}});
+    mColumns.push_back(columnfile::Column{"lon", columnfile::col_double, {}});
+    mColumns.push_back(columnfile::Column{"lat", columnfile::col_double, {}});
+    for(const std::string& key : mKeys) {
+      mColumns.push_back(columnfile::Column{key, columnfile::col_dict, {}});
+    }
+    if(mWithGeometry) {
+      mColumns.push_back(columnfile::Column{"geometry", columnfile::col_blob, {}});
+    }
+    mCodes.resize(mKeys.size());
+    mTagValues.resize(mKeys.size());
+    mGeomOffsets.push_back(0);
+  }
+
+  ColumnFileWriter(const ColumnFileWriter&) = delete;
+  ColumnFileWriter& operator=(const ColumnFileWriter&) = delete;
+
+  // Adds a row, geometry is ignored if the file has no geometry column.
+  // type is the 1-based code of the osm_type levels.
+  void add(const osmium::OSMObject& obj, int32_t type, osmium::object_id_type id, const osmium::Location& location,
+           const std::string& geometry) {
+    mTypes.push_back(type);
+    mIds.push_back(id);
+    mLons.push_back(location.valid() ? location.lon_without_check() : columnfile::naReal());
+    mLats.push_back(location.valid() ? location.lat_without_check() : columnfile::naReal());
+    const osmium::TagList& tags = obj.tags();
+    for(size_t k = 0; k < mKeys.size(); ++k) {
+      const char* value = tags.get_value_by_key(mKeys[k].c_str());
+      mTagValues[k].push_back(value ? code(k, value) : columnfile::na_code);
+    }
+    if(mWithGeometry) {
+      mGeomData += geometry;
+      mGeomOffsets.push_back(mGeomData.size());
+    }
+    if(mTypes.size() == columnfile::chunk_rows) {
+      flush();
+    }
+  }
+
+  // Writes the last chunk and the footer
+  void close() {
+    if(mClosed) {
+      return;
+    }
+    mClosed = true;
+    flush();
+    const uint64_t footer_offset = static_cast<uint64_t>(mOut.tellp());
+    blockindex::write(mOut, static_cast<uint64_t>(mColumns.size()));
+    for(const columnfile::Column& column : mColumns) {
+      blockindex::write(mOut, static_cast<uint8_t>(column.type));
+      columnfile::writeString(mOut, column.name);
+    }
+    for(const columnfile::Column& column : mColumns) {
+      if(column.type == columnfile::col_dict) {
+        blockindex::write(mOut, static_cast<uint32_t>(column.levels.size()));
+        for(const std::string& level : column.levels) {
+          columnfile::writeString(mOut, level);
+        }
+      }
+    }
+    blockindex::write(mOut, static_cast<uint64_t>(mChunks.size()));
+    for(const columnfile::Chunk& chunk : mChunks) {
+      blockindex::write(mOut, chunk.rows);
+      for(const columnfile::Extent& extent : chunk.extents) {
+        blockindex::write(mOut, extent);
+      }
+    }
+    blockindex::write(mOut, footer_offset);
+    mOut.write(columnfile::magic, sizeof(columnfile::magic));
+    mOut.close();
+    if(!mOut) {
+      throw std::runtime_error("error while writing file '" + mFilename + "'");
+    }
+  }
+
+  uint64_t rows() const {
+    return mRows;
+  }
+
+private:
+  int32_t code(size_t k, const char* value) {
+    std::vector<std::string>& levels = mColumns[4 + k].levels;
+    auto it = mCodes[k].find(value);
+    if(it != mCodes[k].end()) {
+      return it->second;
+    }
+    levels.push_back(value);
+    const int32_t ret = static_cast<int32_t>(levels.size());
+    mCodes[k].emplace(levels.back(), ret);
+    return ret;
+  }
+
+  template <typename T>
+  void writeColumn(columnfile::Chunk& chunk, const std::vector<T>& values) {
+    writeBytes(chunk, reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T), 0, 0);
+  }
+
+  void writeBytes(columnfile::Chunk& chunk, const char* data, uint64_t size, const char* data2, uint64_t size2) {
+    const char padding[8] = {0};
+    const uint64_t offset = static_cast<uint64_t>(mOut.tellp());
+    mOut.write(data, size);
+    mOut.write(data2, size2);
+    mOut.write(padding, (8 - (size + size2) % 8) % 8);
+    chunk.extents.push_back(columnfile::Extent{offset, size + size2});
+  }
+
+  void flush() {
+    if(mTypes.empty()) {
+      return;
+    }
+    columnfile::Chunk chunk;
+    chunk.rows = mTypes.size();
+    writeColumn(chunk, mTypes);
+    writeColumn(chunk, mIds);
+    writeColumn(chunk, mLons);
+    writeColumn(chunk, mLats);
+    for(auto& values : mTagValues) {
+      writeColumn(chunk, values);
+      values.clear();
+    }
+    if(mWithGeometry) {
+      writeBytes(chunk, reinterpret_cast<const char*>(mGeomOffsets.data()), mGeomOffsets.size() * sizeof(uint64_t),
+                 mGeomData.data(), mGeomData.size());
+      mGeomOffsets.assign(1, 0);
+      mGeomData.clear();
+    }
+    if(!mOut) {
+      throw std::runtime_error("error while writing file '" + mFilename + "'");
+    }
+    mRows += chunk.rows;
+    mChunks.push_back(chunk);
+    mTypes.clear();
+    mIds.clear();
+    mLons.clear();
+    mLats.clear();
+  }
+
+  std::string mFilename;
+  std::vector<std::string> mKeys;
+  bool mWithGeometry;
+  std::ofstream mOut;
+  bool mClosed = false;
+  uint64_t mRows = 0;
+  std::vector<columnfile::Column> mColumns;
+  std::vector<columnfile::Chunk> mChunks;
+  std::vector<std::unordered_map<std::string, int32_t>> mCodes;
+  // values of the current chunk
+  std::vector<int32_t> mTypes;
+  std::vector<int64_t> mIds;
+  std::vector<double> mLons;
+  std::vector<double> mLats;
+  std::vector<std::vector<int32_t>> mTagValues;
+  // (rows + 1) offsets of the geometries in mGeomData
+  std::vector<uint64_t> mGeomOffsets;
+  std::string mGeomData;
+};
+
+// Memory mapped column file. The values of a column in a chunk can be
+// accessed directly.
+class ColumnFileReader {
+public:
+  ColumnFileReader(const std::string& filename) {
+    const uint64_t file_size = blockindex::fileSize(filename);
+    const uint64_t min_size = 2 * sizeof(columnfile::magic) + 2 * sizeof(uint64_t);
+    if(file_size < min_size) {
+      throw std::runtime_error("'" + filename + "' is not a column file");
+    }
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+      throw std::runtime_error("unable to open file '" + filename + "'");
+    }
+    try {
+      mMapping.reset(new osmium::util::MemoryMapping(file_size, osmium::util::MemoryMapping::mapping_mode::readonly, fd));
+    } catch(...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+    mData = mMapping->get_addr<const char>();
+    mSize = file_size;
+    const char* end = mData + mSize;
+    if(std::memcmp(mData, columnfile::magic, sizeof(columnfile::magic)) ||
+       std::memcmp(end - sizeof(columnfile::magic), columnfile::magic, sizeof(columnfile::magic))) {
+      throw std::runtime_error("'" + filename + "' is not a column file or is truncated");
+    }
+    uint64_t footer_offset;
+    std::memcpy(&footer_offset, end - sizeof(columnfile::magic) - sizeof(uint64_t), sizeof(uint64_t));
+    if(footer_offset < sizeof(columnfile::magic) || footer_offset > mSize - sizeof(columnfile::magic) - sizeof(uint64_t)) {
+      throw std::runtime_error("column file '" + filename + "' is corrupt");
+    }
+    readFooter(mData + footer_offset, end - sizeof(columnfile::magic) - sizeof(uint64_t), filename);
+  }
+
+  const std::vector<columnfile::Column>& columns() const {
+    return mColumns;
+  }
+
+  const std::vector<columnfile::Chunk>& chunks() const {
+    return mChunks;
+  }
+
+  uint64_t rows() const {
+    return mRows;
+  }
+
+  // Index of the column with the given name, -1 if there is none
+  int find(const std::string& name) const {
+    for(size_t i = 0; i < mColumns.size(); ++i) {
+      if(mColumns[i].name == name) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  // The values of a column in a chunk
+  const char* data(size_t chunk, size_t column) const {
+    return mData + mChunks[chunk].extents[column].offset;
+  }
+
+private:
+  template <typename T>
+  T read(const char*& pos, const char* end) const {
+    if(static_cast<size_t>(end - pos) < sizeof(T)) {
+      throw std::runtime_error("column file is corrupt");
+    }
+    T ret;
+    std::memcpy(&ret, pos, sizeof(T));
+    pos += sizeof(T);
+    return ret;
+  }
+
+  std::string readString(const char*& pos, const char* end) const {
+    const uint32_t size = read<uint32_t>(pos, end);
+    if(static_cast<size_t>(end - pos) < size) {
+      throw std::runtime_error("column file is corrupt");
+    }
+    std::string ret(pos, size);
+    pos += size;
+    return ret;
+  }
+
+  void readFooter(const char* pos, const char* end, const std::string& filename) {
+    const uint64_t num_columns = read<uint64_t>(pos, end);
+    for(uint64_t i = 0; i < num_columns; ++i) {
+      columnfile::Column column;
+      column.type = static_cast<columnfile::ColumnType>(read<uint8_t>(pos, end));
+      if(column.type > columnfile::col_blob) {
+        throw std::runtime_error("column file '" + filename + "' has an unknown column type");
+      }
+      column.name = readString(pos, end);
+      mColumns.push_back(column);
+    }
+    for(columnfile::Column& column : mColumns) {
+      if(column.type == columnfile::col_dict) {
+        const uint32_t num_levels = read<uint32_t>(pos, end);
+        for(uint32_t l = 0; l < num_levels; ++l) {
+          column.levels.push_back(readString(pos, end));
+        }
+      }
+    }
+    const uint64_t num_chunks = read<uint64_t>(pos, end);
+    for(uint64_t c = 0; c < num_chunks; ++c) {
+      columnfile::Chunk chunk;
+      chunk.rows = read<uint64_t>(pos, end);
+      for(const columnfile::Column& column : mColumns) {
+        const columnfile::Extent extent = read<columnfile::Extent>(pos, end);
+        if(extent.offset % 8 || extent.offset > mSize || extent.size > mSize - extent.offset || !validExtent(column, chunk.rows, extent)) {
+          throw std::runtime_error("column file '" + filename + "' is corrupt");
+        }
+        chunk.extents.push_back(extent);
+      }
+      mRows += chunk.rows;
+      mChunks.push_back(chunk);
+    }
+  }
+
+  // Checks the size of the extent, the codes of dictionary columns (NA or
+  // 1-based level) and the offsets of blob columns
+  bool validExtent(const columnfile::Column& column, uint64_t rows, const columnfile::Extent& extent) const {
+    if(column.type == columnfile::col_dict) {
+      if(extent.size != rows * columnfile::valueSize(column.type)) {
+        return false;
+      }
+      const int32_t* codes = reinterpret_cast<const int32_t*>(mData + extent.offset);
+      const int64_t num_levels = static_cast<int64_t>(column.levels.size());
+      for(uint64_t r = 0; r < rows; ++r) {
+        if(codes[r] != columnfile::na_code && (codes[r] < 1 || codes[r] > num_levels)) {
+          return false;
+        }
+      }
+      return true;
+    } else if(column.type != columnfile::col_blob) {
+      return extent.size == rows * columnfile::valueSize(column.type);
+    }
+    const uint64_t header_size = (rows + 1) * sizeof(uint64_t);
+    if(extent.size < header_size) {
+      return false;
+    }
+    const uint64_t* offsets = reinterpret_cast<const uint64_t*>(mData + extent.offset);
+    for(uint64_t r = 0; r < rows; ++r) {
+      if(offsets[r] > offsets[r + 1]) {
+        return false;
+      }
+    }
+    return offsets[0] == 0 && offsets[rows] == extent.size - header_size;
+  }
+
+  std::unique_ptr<osmium::util::MemoryMapping> mMapping;
+  const char* mData = nullptr;
+  uint64_t mSize = 0;
+  uint64_t mRows = 0;
+  std::vector<columnfile::Column> mColumns;
+  std::vector<columnfile::Chunk> mChunks;
+};
+
+#endif // COLUMNFILE_HPP
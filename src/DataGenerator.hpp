@@ -0,0 +1,449 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DATAGENERATOR_HPP
+#define DATAGENERATOR_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <osmium/builder/osm_object_builder.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/item_type.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/timestamp.hpp>
+#include <osmium/osm/types.hpp>
+
+namespace datagenerator {
+
+struct Config {
+  uint64_t nodes = 1000000;
+  // ways besides the member ways of the multipolygons
+  uint64_t ways = 100000;
+  // multipolygon relations
+  uint64_t relations = 1000;
+  // fraction of the nodes with tags
+  double taggedNodes = 0.1;
+  // mean number of tags of tagged objects
+  int tagsPerObject = 2;
+  // exponents of the Zipf distributions of the keys and of the values of
+  // each key, 0 for uniform distributions
+  double keySkew = 1.0;
+  double valueSkew = 1.0;
+  // number of values of keys with free text values (name, addr:street, ...)
+  int distinctValues = 1000;
+  // rings of the multipolygons: 1 outer ring, 2 with a hole, 3 with an
+  // island in the hole
+  int ringDepth = 2;
+  // mean difference between consecutive ids, 1 for consecutive ids
+  uint64_t idSpacing = 1;
+  // nodes per street
+  int wayNodes = 10;
+  uint64_t seed = 42;
+};
+
+struct Counts {
+  uint64_t nodes = 0;
+  uint64_t ways = 0;
+  uint64_t relations = 0;
+};
+
+// Keys by decreasing frequency with their values. Keys without values have
+// free text values.
+struct KeyValues {
+  const char* key;
+  std::vector<const char*> values;
+};
+
+inline const std::vector<KeyValues>& keyTable() {
+  static const std::vector<KeyValues> table = {
+    { "building", { "yes", "house", "residential", "garage", "apartments", "industrial", "shed" } },
+    { "highway", { "residential", "service", "track", "footway", "unclassified", "path", "tertiary", "secondary", "primary" } },
+    { "source", { "survey", "bing", "gps", "import" } },
+    { "name", {} },
+    { "addr:housenumber", {} },
+    { "addr:street", {} },
+    { "surface", { "asphalt", "unpaved", "gravel", "paved", "ground", "grass" } },
+    { "natural", { "tree", "water", "wood", "scrub", "wetland" } },
+    { "landuse", { "residential", "farmland", "grass", "forest", "meadow", "industrial" } },
+    { "amenity", { "parking", "bench", "restaurant", "school", "place_of_worship", "cafe", "waste_basket" } },
+    { "oneway", { "yes", "no" } },
+    { "shop", { "supermarket", "convenience", "bakery", "clothes", "hairdresser" } },
+    { "ref", {} },
+    { "note", {} }
+  };
+  return table;
+}
+
+// Random number derived from x only (splitmix64), used for the properties of
+// objects which are referenced by other objects
+inline uint64_t mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Uniform number in [0, 1) from the upper 53 bits
+inline double unit(uint64_t random) {
+  return static_cast<double>(random >> 11) / 9007199254740992.0;
+}
+
+// Indices 0 to n - 1 with probabilities proportional to 1 / (i + 1)^s
+class ZipfDistribution {
+public:
+  ZipfDistribution(size_t n, double s) {
+    double sum = 0.0;
+    mCdf.reserve(n);
+    for(size_t i = 0; i < n; ++i) {
+      sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+      mCdf.push_back(sum);
+    }
+  }
+
+  size_t operator()(uint64_t random) const {
+    auto it = std::upper_bound(mCdf.begin(), mCdf.end(), unit(random) * mCdf.back());
+    return std::min(static_cast<size_t>(it - mCdf.begin()), mCdf.size() - 1);
+  }
+
+private:
+  std::vector<double> mCdf;
+};
+
+} // namespace datagenerator
+
+// Synthetic OSM data for load tests. The nodes form a grid with some jitter,
+// streets run along the rows of the grid, buildings are closed ways around
+// single cells and the multipolygons consist of an outer ring of two ways
+// and optionally a hole and an island in the hole. The objects are created
+// buffer by buffer in the order of a sorted file, so the memory needed does
+// not depend on the size of the data. The same configuration always creates
+// the same objects.
+class DataGenerator {
+public:
+  DataGenerator(const datagenerator::Config& config) :
+    mConfig(config),
+    mKeys(datagenerator::keyTable().size(), config.keySkew) {
+    if(mConfig.idSpacing < 1) {
+      throw std::invalid_argument("id spacing has to be at least 1");
+    }
+    if(mConfig.tagsPerObject < 1 || mConfig.distinctValues < 1) {
+      throw std::invalid_argument("tags per object and number of distinct values have to be positive");
+    }
+    if(mConfig.ringDepth < 1 || mConfig.ringDepth > 3) {
+      throw std::invalid_argument("ring depth has to be 1, 2 or 3");
+    }
+    if(mConfig.wayNodes < 2 || mConfig.wayNodes > 2000) {
+      throw std::invalid_argument("ways need 2 to 2000 nodes");
+    }
+    mColumns = std::max<uint64_t>(16, static_cast<uint64_t>(std::ceil(std::sqrt(static_cast<double>(mConfig.nodes)))));
+    mRows = mConfig.nodes / mColumns;
+    if(mConfig.ways > 0 && mRows < 2) {
+      throw std::invalid_argument("at least " + std::to_string(2 * mColumns) + " nodes are needed for ways");
+    }
+    mMinBlock = 2 * static_cast<uint64_t>(mConfig.ringDepth) - 1;
+    if(mConfig.relations > 0 && (mRows <= mMinBlock || mColumns <= mMinBlock)) {
+      throw std::invalid_argument("too few nodes for multipolygons");
+    }
+    for(const datagenerator::KeyValues& key : datagenerator::keyTable()) {
+      std::vector<std::string> values;
+      if(key.values.empty()) {
+        for(int i = 0; i < mConfig.distinctValues; ++i) {
+          values.push_back(std::string(key.key) + ' ' + std::to_string(i + 1));
+        }
+      } else {
+        values.assign(key.values.begin(), key.values.end());
+      }
+      mValueDistributions.emplace_back(values.size(), mConfig.valueSkew);
+      mValues.push_back(std::move(values));
+    }
+  }
+
+  // Bounding box of the nodes
+  osmium::Box bounds() const {
+    return osmium::Box(lon_origin, lat_origin,
+                       lon_origin + (mColumns + 1) * cell_size, lat_origin + (mRows + 2) * cell_size);
+  }
+
+  // Calls out(osmium::memory::Buffer&&) with the buffers of the nodes, ways
+  // and relations in this order
+  template <typename TFunc>
+  datagenerator::Counts generate(TFunc&& out) {
+    datagenerator::Counts counts;
+    mRandom.seed(mConfig.seed);
+    mBuffer = osmium::memory::Buffer(buffer_size, osmium::memory::Buffer::auto_grow::no);
+
+    for(uint64_t i = 0; i < mConfig.nodes; ++i) {
+      addNode(i);
+      flushIfFull(out);
+    }
+    counts.nodes = mConfig.nodes;
+
+    for(uint64_t i = 0; i < mConfig.ways; ++i) {
+      if(datagenerator::unit(mRandom()) < 0.4) {
+        addBuilding(i);
+      } else {
+        addStreet(i);
+      }
+      flushIfFull(out);
+    }
+    // the positions of the multipolygons are drawn twice from the same
+    // sequence: once for the member ways and once for the relations
+    std::mt19937_64 placement(mConfig.seed + 1);
+    uint64_t way_index = mConfig.ways;
+    for(uint64_t i = 0; i < mConfig.relations; ++i) {
+      Block block = nextBlock(placement);
+      addWay(way_index++, edges(block.row, block.column, block.size, 0, 2), no_tags);
+      addWay(way_index++, edges(block.row, block.column, block.size, 2, 4), no_tags);
+      for(int depth = 1; depth < mConfig.ringDepth; ++depth) {
+        addWay(way_index++, edges(block.row + depth, block.column + depth, block.size - 2 * depth, 0, 4), no_tags);
+      }
+      flushIfFull(out);
+    }
+    counts.ways = way_index;
+
+    placement.seed(mConfig.seed + 1);
+    way_index = mConfig.ways;
+    for(uint64_t i = 0; i < mConfig.relations; ++i) {
+      nextBlock(placement);
+      addMultipolygon(i, way_index);
+      way_index += 1 + static_cast<uint64_t>(mConfig.ringDepth);
+      flushIfFull(out);
+    }
+    counts.relations = mConfig.relations;
+
+    if(mBuffer.committed() > 0) {
+      out(std::move(mBuffer));
+    }
+    return counts;
+  }
+
+private:
+  static const size_t buffer_size = 1024 * 1024;
+  // space left for the next object
+  static const size_t buffer_reserve = 64 * 1024;
+  static constexpr double lon_origin = 8.0;
+  static constexpr double lat_origin = 47.0;
+  static constexpr double cell_size = 1e-4;
+  // 2016-01-01
+  static const uint32_t first_timestamp = 1451606400;
+
+  // Indices into the key table or how to tag an object
+  enum {
+    no_tags = -2,
+    random_tags = -1,
+    building_key = 0,
+    highway_key = 1,
+    landuse_key = 8
+  };
+
+  struct Block {
+    uint64_t row;
+    uint64_t column;
+    uint64_t size;
+  };
+
+  template <typename TFunc>
+  void flushIfFull(TFunc& out) {
+    if(mBuffer.capacity() - mBuffer.committed() < buffer_reserve) {
+      out(std::move(mBuffer));
+      mBuffer = osmium::memory::Buffer(buffer_size, osmium::memory::Buffer::auto_grow::no);
+    }
+  }
+
+  // Ids are ascending, the distance between consecutive ids is between 1 and
+  // 2 * idSpacing - 1
+  osmium::object_id_type objectId(uint64_t index, osmium::item_type type) const {
+    uint64_t id = index * mConfig.idSpacing + 1;
+    if(mConfig.idSpacing > 1) {
+      id += datagenerator::mix(mConfig.seed ^ (index << 2) ^ static_cast<uint64_t>(type)) % mConfig.idSpacing;
+    }
+    return static_cast<osmium::object_id_type>(id);
+  }
+
+  osmium::object_id_type nodeId(uint64_t row, uint64_t column) const {
+    return objectId(row * mColumns + column, osmium::item_type::node);
+  }
+
+  template <typename TBuilder>
+  void setAttributes(TBuilder& builder, uint64_t index, osmium::item_type type) {
+    uint64_t random = datagenerator::mix(mConfig.seed + index * 4 + static_cast<uint64_t>(type));
+    builder.object().set_id(objectId(index, type));
+    builder.object().set_version(static_cast<osmium::object_version_type>(1 + random % 5));
+    builder.object().set_changeset(static_cast<osmium::changeset_id_type>(1 + index / 1000));
+    builder.object().set_uid(static_cast<osmium::user_id_type>(1 + (random >> 8) % 1000));
+    builder.object().set_timestamp(osmium::Timestamp(first_timestamp + static_cast<uint32_t>((random >> 20) % (365 * 24 * 3600))));
+    builder.add_user("generator");
+  }
+
+  // Adds the fixed tag (if any), the forced key (if any) and random tags with
+  // different keys, tagsPerObject tags on average
+  void addTags(osmium::builder::Builder& parent, int forced_key, const char* fixed_key = nullptr, const char* fixed_value = nullptr) {
+    if(forced_key == no_tags) {
+      return;
+    }
+    std::vector<int> keys;
+    if(forced_key >= 0) {
+      keys.push_back(forced_key);
+    }
+    const uint64_t count = mRandom() % (2 * static_cast<uint64_t>(mConfig.tagsPerObject) - 1) + (forced_key >= 0 ? 0 : 1);
+    for(uint64_t i = 0; i < count; ++i) {
+      int key = static_cast<int>(mKeys(mRandom()));
+      if(std::find(keys.begin(), keys.end(), key) == keys.end()) {
+        keys.push_back(key);
+      }
+    }
+    osmium::builder::TagListBuilder tags(mBuffer, &parent);
+    if(fixed_key) {
+      tags.add_tag(fixed_key, fixed_value);
+    }
+    for(int key : keys) {
+      tags.add_tag(datagenerator::keyTable()[key].key, mValues[key][mValueDistributions[key](mRandom())]);
+    }
+  }
+
+  void addNode(uint64_t index) {
+    const uint64_t row = index / mColumns;
+    const uint64_t column = index % mColumns;
+    const uint64_t jitter = datagenerator::mix(~mConfig.seed ^ index);
+    {
+      osmium::builder::NodeBuilder builder(mBuffer);
+      setAttributes(builder, index, osmium::item_type::node);
+      builder.object().set_location(osmium::Location(lon_origin + column * cell_size + (jitter % 50) * 1e-7,
+                                                     lat_origin + row * cell_size + ((jitter >> 16) % 50) * 1e-7));
+      if(datagenerator::unit(mRandom()) < mConfig.taggedNodes) {
+        addTags(builder, random_tags);
+      }
+    }
+    mBuffer.commit();
+  }
+
+  // Nodes on the sides first to last - 1 (0 top, 1 right, 2 bottom, 3 left)
+  // of the square with the given upper left corner
+  std::vector<osmium::object_id_type> edges(uint64_t row, uint64_t column, uint64_t size, int first, int last) const {
+    std::vector<osmium::object_id_type> refs;
+    for(int side = first; side < last; ++side) {
+      for(uint64_t k = 0; k < size; ++k) {
+        switch(side) {
+        case 0:
+          refs.push_back(nodeId(row, column + k));
+          break;
+        case 1:
+          refs.push_back(nodeId(row + k, column + size));
+          break;
+        case 2:
+          refs.push_back(nodeId(row + size, column + size - k));
+          break;
+        default:
+          refs.push_back(nodeId(row + size - k, column));
+        }
+      }
+    }
+    // the first node of the next side
+    switch(last % 4) {
+    case 0:
+      refs.push_back(nodeId(row, column));
+      break;
+    case 1:
+      refs.push_back(nodeId(row, column + size));
+      break;
+    case 2:
+      refs.push_back(nodeId(row + size, column + size));
+      break;
+    default:
+      refs.push_back(nodeId(row + size, column));
+    }
+    return refs;
+  }
+
+  void addWay(uint64_t index, const std::vector<osmium::object_id_type>& refs, int forced_key) {
+    {
+      osmium::builder::WayBuilder builder(mBuffer);
+      setAttributes(builder, index, osmium::item_type::way);
+      {
+        osmium::builder::WayNodeListBuilder nodes(mBuffer, &builder);
+        for(osmium::object_id_type ref : refs) {
+          nodes.add_node_ref(ref);
+        }
+      }
+      addTags(builder, forced_key);
+    }
+    mBuffer.commit();
+  }
+
+  void addStreet(uint64_t index) {
+    const uint64_t length = std::min<uint64_t>(mConfig.wayNodes, mColumns);
+    const uint64_t row = mRandom() % mRows;
+    const uint64_t column = mRandom() % (mColumns - length + 1);
+    std::vector<osmium::object_id_type> refs;
+    for(uint64_t k = 0; k < length; ++k) {
+      refs.push_back(nodeId(row, column + k));
+    }
+    addWay(index, refs, highway_key);
+  }
+
+  void addBuilding(uint64_t index) {
+    const uint64_t row = mRandom() % (mRows - 1);
+    const uint64_t column = mRandom() % (mColumns - 1);
+    addWay(index, edges(row, column, 1, 0, 4), building_key);
+  }
+
+  Block nextBlock(std::mt19937_64& placement) const {
+    const uint64_t max_size = std::min<uint64_t>(mMinBlock + 6, std::min(mRows, mColumns) - 1);
+    Block block;
+    block.size = mMinBlock + placement() % (max_size - mMinBlock + 1);
+    block.row = placement() % (mRows - block.size);
+    block.column = placement() % (mColumns - block.size);
+    return block;
+  }
+
+  void addMultipolygon(uint64_t index, uint64_t first_way) {
+    {
+      osmium::builder::RelationBuilder builder(mBuffer);
+      setAttributes(builder, index, osmium::item_type::relation);
+      {
+        osmium::builder::RelationMemberListBuilder members(mBuffer, &builder);
+        members.add_member(osmium::item_type::way, objectId(first_way, osmium::item_type::way), "outer");
+        members.add_member(osmium::item_type::way, objectId(first_way + 1, osmium::item_type::way), "outer");
+        for(int depth = 1; depth < mConfig.ringDepth; ++depth) {
+          members.add_member(osmium::item_type::way, objectId(first_way + 1 + depth, osmium::item_type::way), depth % 2 ? "inner" : "outer");
+        }
+      }
+      addTags(builder, landuse_key, "type", "multipolygon");
+    }
+    mBuffer.commit();
+  }
+
+  datagenerator::Config mConfig;
+  datagenerator::ZipfDistribution mKeys;
+  std::vector<std::vector<std::string>> mValues;
+  std::vector<datagenerator::ZipfDistribution> mValueDistributions;
+  std::mt19937_64 mRandom;
+  osmium::memory::Buffer mBuffer;
+  uint64_t mColumns;
+  uint64_t mRows;
+  uint64_t mMinBlock;
+};
+
+#endif // DATAGENERATOR_HPP
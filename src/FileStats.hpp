@@ -0,0 +1,260 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef FILESTATS_HPP
+#define FILESTATS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <protozero/pbf_message.hpp>
+#include <osmium/io/detail/pbf_decoder.hpp>
+#include <osmium/io/detail/protobuf_tags.hpp>
+#include <osmium/io/reader.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/timestamp.hpp>
+#include <osmium/thread/pool.hpp>
+#include <osmium/util/delta.hpp>
+
+#include "BlockIndex.hpp"
+
+// Statistics of (a part of) a file. Partial statistics computed on different
+// threads are combined with merge().
+struct FileStats {
+  uint64_t count[3] = { 0, 0, 0 };
+  osmium::object_id_type minId[3] = { std::numeric_limits<osmium::object_id_type>::max(),
+                                      std::numeric_limits<osmium::object_id_type>::max(),
+                                      std::numeric_limits<osmium::object_id_type>::max() };
+  osmium::object_id_type maxId[3] = { std::numeric_limits<osmium::object_id_type>::min(),
+                                      std::numeric_limits<osmium::object_id_type>::min(),
+                                      std::numeric_limits<osmium::object_id_type>::min() };
+  osmium::Timestamp firstTimestamp = osmium::end_of_time();
+  osmium::Timestamp lastTimestamp = osmium::start_of_time();
+  osmium::Box box;
+  std::unordered_map<std::string, uint64_t> keys;
+
+  void addId(int slot, osmium::object_id_type id) {
+    ++count[slot];
+    minId[slot] = std::min(minId[slot], id);
+    maxId[slot] = std::max(maxId[slot], id);
+  }
+
+  void add(const osmium::OSMObject& obj, bool with_keys) {
+    int slot = blockIndexSlot(obj.type());
+    if(slot < 0) {
+      return;
+    }
+    addId(slot, obj.id());
+    if(obj.timestamp().valid()) {
+      firstTimestamp = std::min(firstTimestamp, obj.timestamp());
+      lastTimestamp = std::max(lastTimestamp, obj.timestamp());
+    }
+    if(obj.type() == osmium::item_type::node) {
+      const osmium::Location& loc = static_cast<const osmium::Node&>(obj).location();
+      if(loc.valid()) {
+        box.extend(loc);
+      }
+    }
+    if(with_keys) {
+      for(const osmium::Tag& tag : obj.tags()) {
+        ++keys[tag.key()];
+      }
+    }
+  }
+
+  void merge(const FileStats& other) {
+    for(int slot = slot_node; slot <= slot_relation; ++slot) {
+      count[slot] += other.count[slot];
+      minId[slot] = std::min(minId[slot], other.minId[slot]);
+      maxId[slot] = std::max(maxId[slot], other.maxId[slot]);
+    }
+    firstTimestamp = std::min(firstTimestamp, other.firstTimestamp);
+    lastTimestamp = std::max(lastTimestamp, other.lastTimestamp);
+    box.extend(other.box);
+    for(const auto& key : other.keys) {
+      keys[key.first] += key.second;
+    }
+  }
+};
+
+namespace filestats {
+
+// Computes the statistics of one buffer on a pool thread
+class BufferStatsTask {
+public:
+  BufferStatsTask(osmium::memory::Buffer&& buffer, bool with_keys) :
+    mBuffer(std::make_shared<osmium::memory::Buffer>(std::move(buffer))), mWithKeys(with_keys) {
+  }
+
+  FileStats operator()() {
+    FileStats stats;
+    for(auto it = mBuffer->cbegin<osmium::OSMObject>(); it != mBuffer->cend<osmium::OSMObject>(); ++it) {
+      stats.add(*it, mWithKeys);
+    }
+    return stats;
+  }
+
+private:
+  std::shared_ptr<osmium::memory::Buffer> mBuffer;
+  bool mWithKeys;
+};
+
+// Counts the objects of one PBF blob and determines their id ranges without
+// building OSM objects (dense nodes are only counted by their id array).
+class BlobCountTask {
+public:
+  BlobCountTask(std::string&& blob, osmium::osm_entity_bits::type read_types) :
+    mBlob(std::make_shared<std::string>(std::move(blob))), mReadTypes(read_types) {
+  }
+
+  FileStats operator()() {
+    namespace pbf = osmium::io::detail;
+    FileStats stats;
+    std::string output;
+    protozero::pbf_message<pbf::OSMFormat::PrimitiveBlock> pbf_primitive_block(pbf::decode_blob(*mBlob, output));
+    while(pbf_primitive_block.next(pbf::OSMFormat::PrimitiveBlock::repeated_PrimitiveGroup_primitivegroup)) {
+      protozero::pbf_message<pbf::OSMFormat::PrimitiveGroup> pbf_primitive_group = pbf_primitive_block.get_message();
+      while(pbf_primitive_group.next()) {
+        switch(pbf_primitive_group.tag()) {
+        case pbf::OSMFormat::PrimitiveGroup::optional_DenseNodes_dense:
+          if(mReadTypes & osmium::osm_entity_bits::node) {
+            countDenseNodes(pbf_primitive_group.get_message(), stats);
+          } else {
+            pbf_primitive_group.skip();
+          }
+          break;
+        case pbf::OSMFormat::PrimitiveGroup::repeated_Node_nodes:
+          if(mReadTypes & osmium::osm_entity_bits::node) {
+            protozero::pbf_message<pbf::OSMFormat::Node> pbf_node = pbf_primitive_group.get_message();
+            if(pbf_node.next(pbf::OSMFormat::Node::required_sint64_id)) {
+              stats.addId(slot_node, pbf_node.get_sint64());
+            }
+          } else {
+            pbf_primitive_group.skip();
+          }
+          break;
+        case pbf::OSMFormat::PrimitiveGroup::repeated_Way_ways:
+          if(mReadTypes & osmium::osm_entity_bits::way) {
+            protozero::pbf_message<pbf::OSMFormat::Way> pbf_way = pbf_primitive_group.get_message();
+            if(pbf_way.next(pbf::OSMFormat::Way::required_int64_id)) {
+              stats.addId(slot_way, pbf_way.get_int64());
+            }
+          } else {
+            pbf_primitive_group.skip();
+          }
+          break;
+        case pbf::OSMFormat::PrimitiveGroup::repeated_Relation_relations:
+          if(mReadTypes & osmium::osm_entity_bits::relation) {
+            protozero::pbf_message<pbf::OSMFormat::Relation> pbf_relation = pbf_primitive_group.get_message();
+            if(pbf_relation.next(pbf::OSMFormat::Relation::required_int64_id)) {
+              stats.addId(slot_relation, pbf_relation.get_int64());
+            }
+          } else {
+            pbf_primitive_group.skip();
+          }
+          break;
+        default:
+          pbf_primitive_group.skip();
+        }
+      }
+    }
+    return stats;
+  }
+
+private:
+
+  void countDenseNodes(protozero::pbf_message<osmium::io::detail::OSMFormat::DenseNodes> pbf_dense_nodes, FileStats& stats) {
+    while(pbf_dense_nodes.next(osmium::io::detail::OSMFormat::DenseNodes::packed_sint64_id)) {
+      auto ids = pbf_dense_nodes.get_packed_sint64();
+      osmium::util::DeltaDecode<int64_t> dense_id;
+      while(ids.first != ids.second) {
+        stats.addId(slot_node, dense_id.update(*ids.first++));
+      }
+    }
+  }
+
+  std::shared_ptr<std::string> mBlob;
+  osmium::osm_entity_bits::type mReadTypes;
+};
+
+inline void mergeFront(std::deque<std::future<FileStats>>& pending, FileStats& stats) {
+  stats.merge(pending.front().get());
+  pending.pop_front();
+}
+
+} // namespace filestats
+
+// Decodes the whole file and computes the statistics per buffer on the
+// osmium pool
+inline FileStats computeFileStats(const std::string& filename, osmium::osm_entity_bits::type read_types, bool with_keys) {
+  FileStats stats;
+  std::deque<std::future<FileStats>> pending;
+  osmium::io::Reader reader(filename, read_types);
+  while(osmium::memory::Buffer buffer = reader.read()) {
+    pending.push_back(osmium::thread::Pool::instance().submit(filestats::BufferStatsTask(std::move(buffer), with_keys)));
+    if(pending.size() > blockindex::max_pending) {
+      filestats::mergeFront(pending, stats);
+    }
+  }
+  reader.close();
+  while(!pending.empty()) {
+    filestats::mergeFront(pending, stats);
+  }
+  return stats;
+}
+
+// Counts the objects of a PBF file (and their id ranges) without decoding
+// tags, locations or metadata
+inline FileStats countPBF(const std::string& filename, osmium::osm_entity_bits::type read_types) {
+  std::ifstream in(filename, std::ios::binary);
+  if(!in) {
+    throw std::runtime_error("unable to open file '" + filename + "'");
+  }
+  FileStats stats;
+  std::deque<std::future<FileStats>> pending;
+  std::string type;
+  std::string blob;
+  uint64_t offset = 0;
+  while(uint64_t size = blockindex::readBlob(in, offset, type, blob)) {
+    if(type == "OSMData") {
+      pending.push_back(osmium::thread::Pool::instance().submit(filestats::BlobCountTask(std::move(blob), read_types)));
+      if(pending.size() > blockindex::max_pending) {
+        filestats::mergeFront(pending, stats);
+      }
+    }
+    offset += size;
+  }
+  while(!pending.empty()) {
+    filestats::mergeFront(pending, stats);
+  }
+  return stats;
+}
+
+#endif // FILESTATS_HPP
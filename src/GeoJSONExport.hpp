@@ -0,0 +1,222 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GEOJSONEXPORT_HPP
+#define GEOJSONEXPORT_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <osmium/geom/factory.hpp>
+#include <osmium/geom/geojson.hpp>
+#include <osmium/io/compression.hpp>
+#include <osmium/io/detail/queue_util.hpp>
+#include <osmium/io/detail/read_write.hpp>
+#include <osmium/io/detail/write_thread.hpp>
+#include <osmium/io/file.hpp>
+#include <osmium/io/gzip_compression.hpp>
+#include <osmium/io/writer_options.hpp>
+#include <osmium/osm/area.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/tag.hpp>
+#include <osmium/osm/way.hpp>
+#include <osmium/thread/util.hpp>
+
+namespace geojsonexport {
+
+// Appends str as JSON string
+inline void appendString(std::string& out, const char* str) {
+  out += '"';
+  for(; *str; ++str) {
+    const char c = *str;
+    if(c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if(static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(c));
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+} // namespace geojsonexport
+
+// Writes objects with their geometries as newline delimited GeoJSON features
+// (GeoJSONSeq). The features are collected in chunks which are compressed
+// (for file names ending with .gz) and written on a separate thread like the
+// output of osmium::io::Writer.
+class GeoJSONSeqWriter {
+public:
+  // Only the tags with the given keys are written, all tags if keys is empty
+  GeoJSONSeqWriter(const std::string& filename, const std::vector<std::string>& keys, bool overwrite) :
+    mKeys(keys),
+    mQueue(20, "geojson_output") {
+    std::unique_ptr<osmium::io::Compressor> compressor =
+      osmium::io::CompressionFactory::instance().create_compressor(osmium::io::File(filename).compression(),
+        osmium::io::detail::open_for_writing(filename, overwrite ? osmium::io::overwrite::allow : osmium::io::overwrite::no),
+        osmium::io::fsync::no);
+    std::promise<bool> write_promise;
+    mWriteFuture = write_promise.get_future();
+    mThread = osmium::thread::thread_handler{write_thread, std::ref(mQueue), std::move(compressor), std::move(write_promise)};
+    mChunk.reserve(chunk_size + chunk_reserve);
+  }
+
+  GeoJSONSeqWriter(const GeoJSONSeqWriter&) = delete;
+  GeoJSONSeqWriter& operator=(const GeoJSONSeqWriter&) = delete;
+
+  ~GeoJSONSeqWriter() {
+    try {
+      close();
+    } catch(...) {
+      // the destructor must not throw, call close() to get the errors
+    }
+  }
+
+  void node(const osmium::Node& node) {
+    if(!node.location().valid()) {
+      ++mSkipped;
+      return;
+    }
+    startFeature(node, "node", node.id());
+    mChunk += mFactory.create_point(node.location());
+    finishFeature();
+  }
+
+  void way(const osmium::Way& way) {
+    try {
+      std::string geometry = mFactory.create_linestring(way);
+      startFeature(way, "way", way.id());
+      mChunk += geometry;
+      finishFeature();
+    } catch(osmium::geometry_error&) {
+      ++mSkipped;
+    } catch(osmium::invalid_location&) {
+      ++mSkipped;
+    }
+  }
+
+  void area(const osmium::Area& area) {
+    try {
+      std::string geometry = mFactory.create_multipolygon(area);
+      startFeature(area, area.from_way() ? "way" : "relation", area.orig_id());
+      mChunk += geometry;
+      finishFeature();
+    } catch(osmium::geometry_error&) {
+      ++mSkipped;
+    } catch(osmium::invalid_location&) {
+      ++mSkipped;
+    }
+  }
+
+  // Writes the last chunk and waits until all data is written. Throws if the
+  // file couldn't be written.
+  void close() {
+    if(!mClosed) {
+      mClosed = true;
+      if(!mChunk.empty()) {
+        osmium::io::detail::add_to_queue(mQueue, std::move(mChunk));
+      }
+      osmium::io::detail::add_end_of_data_to_queue(mQueue);
+      if(mWriteFuture.valid()) {
+        mWriteFuture.get();
+      }
+    }
+  }
+
+  uint64_t features() const {
+    return mFeatures;
+  }
+
+  // Objects without valid geometry
+  uint64_t skipped() const {
+    return mSkipped;
+  }
+
+private:
+  static const size_t chunk_size = 1024 * 1024;
+  static const size_t chunk_reserve = 64 * 1024;
+
+  static void write_thread(osmium::io::detail::future_string_queue_type& queue,
+                           std::unique_ptr<osmium::io::Compressor>&& compressor,
+                           std::promise<bool>&& write_promise) {
+    osmium::io::detail::WriteThread write_thread{queue, std::move(compressor), std::move(write_promise)};
+    write_thread();
+  }
+
+  void startFeature(const osmium::OSMObject& obj, const char* type, osmium::object_id_type id) {
+    mChunk += "{\"type\":\"Feature\",\"properties\":{\"osm_type\":\"";
+    mChunk += type;
+    mChunk += "\",\"osm_id\":";
+    mChunk += std::to_string(id);
+    for(const osmium::Tag& tag : obj.tags()) {
+      if(keepKey(tag.key())) {
+        mChunk += ',';
+        geojsonexport::appendString(mChunk, tag.key());
+        mChunk += ':';
+        geojsonexport::appendString(mChunk, tag.value());
+      }
+    }
+    mChunk += "},\"geometry\":";
+  }
+
+  void finishFeature() {
+    mChunk += "}\n";
+    ++mFeatures;
+    if(mChunk.size() >= chunk_size) {
+      osmium::thread::check_for_exception(mWriteFuture);
+      osmium::io::detail::add_to_queue(mQueue, std::move(mChunk));
+      mChunk = std::string();
+      mChunk.reserve(chunk_size + chunk_reserve);
+    }
+  }
+
+  bool keepKey(const char* key) const {
+    if(mKeys.empty()) {
+      return true;
+    }
+    for(const std::string& k : mKeys) {
+      if(k == key) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<std::string> mKeys;
+  osmium::geom::GeoJSONFactory<> mFactory;
+  std::string mChunk;
+  uint64_t mFeatures = 0;
+  uint64_t mSkipped = 0;
+  bool mClosed = false;
+  osmium::io::detail::future_string_queue_type mQueue;
+  std::future<bool> mWriteFuture;
+  // declared last, so the thread is joined before the queue is destroyed
+  osmium::thread::thread_handler mThread;
+};
+
+#endif // GEOJSONEXPORT_HPP
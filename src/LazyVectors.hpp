@@ -0,0 +1,219 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef LAZYVECTORS_HPP
+#define LAZYVECTORS_HPP
+
+#include <Rcpp.h>
+#include <Rversion.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/item_type.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/object.hpp>
+
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 6, 0)
+#define ROSMIUM_ALTREP 1
+#include <R_ext/Altrep.h>
+#endif
+
+// Copies of OSM objects kept in one buffer. Columns created from the store
+// keep it alive and decode the values on access.
+class ObjectStore {
+public:
+
+  void add(const osmium::OSMObject& obj) {
+    mOffsets.push_back(mBuffer.committed());
+    mBuffer.add_item(obj);
+    mBuffer.commit();
+  }
+
+  size_t size() const {
+    return mOffsets.size();
+  }
+
+  const osmium::OSMObject& get(size_t i) const {
+    return mBuffer.get<const osmium::OSMObject>(mOffsets[i]);
+  }
+
+private:
+  osmium::memory::Buffer mBuffer { 1024 * 1024, osmium::memory::Buffer::auto_grow::yes };
+  std::vector<size_t> mOffsets;
+};
+
+enum LazyField {
+  field_id,
+  field_lon,
+  field_lat,
+  field_type,
+  field_tag
+};
+
+struct LazyColumn {
+  std::shared_ptr<ObjectStore> store;
+  LazyField field;
+  std::string key;
+
+  double realElt(size_t i) const {
+    const osmium::OSMObject& obj = store->get(i);
+    switch(field) {
+    case field_id:
+      return static_cast<double>(obj.id());
+    case field_lon:
+    case field_lat:
+      if(obj.type() == osmium::item_type::node) {
+        const osmium::Location& loc = static_cast<const osmium::Node&>(obj).location();
+        if(loc.valid()) {
+          return field == field_lon ? loc.lon_without_check() : loc.lat_without_check();
+        }
+      }
+      return NA_REAL;
+    default:
+      return NA_REAL;
+    }
+  }
+
+  SEXP stringElt(size_t i) const {
+    const osmium::OSMObject& obj = store->get(i);
+    if(field == field_type) {
+      return Rf_mkChar(osmium::item_type_to_name(obj.type()));
+    }
+    const char* value = obj.tags().get_value_by_key(key.c_str());
+    return value == nullptr ? NA_STRING : Rf_mkCharCE(value, CE_UTF8);
+  }
+
+  bool isString() const {
+    return field == field_type || field == field_tag;
+  }
+};
+
+// Materializes the whole column
+inline SEXP materializeColumn(const LazyColumn& column) {
+  R_xlen_t n = column.store->size();
+  if(column.isString()) {
+    Rcpp::CharacterVector ret(n);
+    for(R_xlen_t i = 0; i < n; ++i) {
+      SET_STRING_ELT(ret, i, column.stringElt(i));
+    }
+    return ret;
+  }
+  Rcpp::NumericVector ret(n);
+  for(R_xlen_t i = 0; i < n; ++i) {
+    ret[i] = column.realElt(i);
+  }
+  return ret;
+}
+
+#ifdef ROSMIUM_ALTREP
+
+namespace lazyvectors {
+
+static R_altrep_class_t real_class;
+static R_altrep_class_t string_class;
+
+inline LazyColumn& column(SEXP x) {
+  Rcpp::XPtr<LazyColumn> ptr(R_altrep_data1(x));
+  return *ptr;
+}
+
+// The materialized vector is stored in data2 once created
+inline SEXP materialized(SEXP x) {
+  SEXP data2 = R_altrep_data2(x);
+  if(data2 == R_NilValue) {
+    data2 = materializeColumn(column(x));
+    R_set_altrep_data2(x, data2);
+  }
+  return data2;
+}
+
+inline R_xlen_t length(SEXP x) {
+  return column(x).store->size();
+}
+
+inline Rboolean inspect(SEXP x, int pre, int deep, int pvec, void (*inspect_subtree)(SEXP, int, int, int)) {
+  Rprintf("lazy osm column (%s)\n", R_altrep_data2(x) == R_NilValue ? "not materialized" : "materialized");
+  return TRUE;
+}
+
+inline void* dataptr(SEXP x, Rboolean writeable) {
+  return DATAPTR(materialized(x));
+}
+
+inline const void* dataptrOrNull(SEXP x) {
+  SEXP data2 = R_altrep_data2(x);
+  return data2 == R_NilValue ? nullptr : DATAPTR(data2);
+}
+
+inline double realElt(SEXP x, R_xlen_t i) {
+  SEXP data2 = R_altrep_data2(x);
+  return data2 == R_NilValue ? column(x).realElt(i) : REAL(data2)[i];
+}
+
+inline SEXP stringElt(SEXP x, R_xlen_t i) {
+  SEXP data2 = R_altrep_data2(x);
+  return data2 == R_NilValue ? column(x).stringElt(i) : STRING_ELT(data2, i);
+}
+
+inline void stringSetElt(SEXP x, R_xlen_t i, SEXP value) {
+  SET_STRING_ELT(materialized(x), i, value);
+}
+
+inline void registerClasses(DllInfo* dll) {
+  real_class = R_make_altreal_class("osm_real", "Rosmium", dll);
+  R_set_altrep_Length_method(real_class, length);
+  R_set_altrep_Inspect_method(real_class, inspect);
+  R_set_altvec_Dataptr_method(real_class, dataptr);
+  R_set_altvec_Dataptr_or_null_method(real_class, dataptrOrNull);
+  R_set_altreal_Elt_method(real_class, realElt);
+
+  string_class = R_make_altstring_class("osm_string", "Rosmium", dll);
+  R_set_altrep_Length_method(string_class, length);
+  R_set_altrep_Inspect_method(string_class, inspect);
+  R_set_altvec_Dataptr_method(string_class, dataptr);
+  R_set_altvec_Dataptr_or_null_method(string_class, dataptrOrNull);
+  R_set_altstring_Elt_method(string_class, stringElt);
+  R_set_altstring_Set_elt_method(string_class, stringSetElt);
+}
+
+} // namespace lazyvectors
+
+#endif // ROSMIUM_ALTREP
+
+// Creates a column which decodes the values on access. Without ALTREP
+// support (R < 3.6) the column is materialized immediately.
+inline SEXP makeLazyColumn(std::shared_ptr<ObjectStore> store, LazyField field, const std::string& key = "") {
+  LazyColumn* column = new LazyColumn { store, field, key };
+#ifdef ROSMIUM_ALTREP
+  Rcpp::XPtr<LazyColumn> ptr(column, true);
+  return R_new_altrep(column->isString() ? lazyvectors::string_class : lazyvectors::real_class, ptr, R_NilValue);
+#else
+  std::unique_ptr<LazyColumn> owner(column);
+  return materializeColumn(*column);
+#endif
+}
+
+inline void registerLazyVectorClasses(DllInfo* dll) {
+#ifdef ROSMIUM_ALTREP
+  lazyvectors::registerClasses(dll);
+#endif
+}
+
+#endif // LAZYVECTORS_HPP
@@ -0,0 +1,223 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MEMBERSHIPINDEX_HPP
+#define MEMBERSHIPINDEX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#include <osmium/handler/object_relations.hpp>
+#include <osmium/index/detail/sorted_lookup.hpp>
+#include <osmium/index/multimap/sparse_mem_array.hpp>
+#include <osmium/io/reader.hpp>
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/util/memory_mapping.hpp>
+#include <osmium/visitor.hpp>
+
+#include "BlockIndex.hpp"
+
+namespace membershipindex {
+
+const char magic[8] = { 'R', 'O', 'S', 'M', 'M', 'I', 'X', '1' };
+
+// (member id, parent id), sorted by member id and parent id
+typedef std::pair<osmium::unsigned_object_id_type, osmium::unsigned_object_id_type> entry_type;
+
+typedef osmium::index::multimap::SparseMemArray<osmium::unsigned_object_id_type, osmium::unsigned_object_id_type> multimap_type;
+
+// The kinds of memberships stored in the index
+enum Table {
+  node_way = 0,
+  node_relation = 1,
+  way_relation = 2,
+  relation_relation = 3,
+  num_tables = 4
+};
+
+// Memory of the index: either the multimaps filled by build() or the mapped
+// index file
+struct Storage {
+  multimap_type maps[num_tables];
+  std::unique_ptr<osmium::util::MemoryMapping> mapping;
+};
+
+// Sorted entries of one table
+struct TableView {
+  const entry_type* first = nullptr;
+  const entry_type* last = nullptr;
+
+  size_t size() const {
+    return last - first;
+  }
+};
+
+} // namespace membershipindex
+
+// Reverse membership index of a file: for every node the ways and relations
+// containing it, for every way and relation the relations containing it.
+// Like ObjectRelations, only positive ids are supported. The index can be
+// saved and is memory mapped when loaded again. Copies share the memory.
+class MembershipIndex {
+public:
+  typedef membershipindex::entry_type entry_type;
+
+  MembershipIndex(std::string filename) : mFilename(filename) {
+    mStorage = std::make_shared<membershipindex::Storage>();
+  }
+
+  std::string getFilename() {
+    return mFilename;
+  }
+
+  double size() {
+    size_t n = 0;
+    for(const auto& table : mTables) {
+      n += table.size();
+    }
+    return static_cast<double>(n);
+  }
+
+  // Reads the ways and relations of the file once
+  void build() {
+    const uint64_t file_size = blockindex::fileSize(mFilename);
+    auto storage = std::make_shared<membershipindex::Storage>();
+    auto& maps = storage->maps;
+    osmium::handler::ObjectRelations handler(maps[membershipindex::node_way], maps[membershipindex::node_relation],
+                                             maps[membershipindex::way_relation], maps[membershipindex::relation_relation]);
+    osmium::io::Reader reader(mFilename, osmium::osm_entity_bits::way | osmium::osm_entity_bits::relation);
+    osmium::apply(reader, handler);
+    reader.close();
+    for(int t = 0; t < membershipindex::num_tables; ++t) {
+      maps[t].sort();
+      mTables[t].first = maps[t].cbegin() == maps[t].cend() ? nullptr : &*maps[t].cbegin();
+      mTables[t].last = mTables[t].first + maps[t].size();
+    }
+    mStorage = storage;
+    mFileSize = file_size;
+  }
+
+  // Layout: magic, size of the indexed file, number of entries per table and
+  // the entries of all tables
+  void save(std::string idx_file) {
+    std::ofstream out(idx_file, std::ios::binary | std::ios::trunc);
+    if(!out) {
+      throw std::runtime_error("unable to open index file '" + idx_file + "' for writing");
+    }
+    out.write(membershipindex::magic, sizeof(membershipindex::magic));
+    blockindex::write(out, mFileSize);
+    for(const auto& table : mTables) {
+      blockindex::write(out, static_cast<uint64_t>(table.size()));
+    }
+    for(const auto& table : mTables) {
+      out.write(reinterpret_cast<const char*>(table.first), table.size() * sizeof(entry_type));
+    }
+    if(!out) {
+      throw std::runtime_error("error while writing index file '" + idx_file + "'");
+    }
+  }
+
+  void load(std::string idx_file) {
+    const uint64_t header_size = sizeof(membershipindex::magic) + sizeof(uint64_t) * (1 + membershipindex::num_tables);
+    const uint64_t idx_size = blockindex::fileSize(idx_file);
+    int fd = ::open(idx_file.c_str(), O_RDONLY);
+    if(fd < 0) {
+      throw std::runtime_error("unable to open index file '" + idx_file + "'");
+    }
+    auto storage = std::make_shared<membershipindex::Storage>();
+    try {
+      if(idx_size < header_size) {
+        throw std::runtime_error("'" + idx_file + "' is not a membership index file");
+      }
+      storage->mapping.reset(new osmium::util::MemoryMapping(idx_size, osmium::util::MemoryMapping::mapping_mode::readonly, fd));
+    } catch(...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+    const char* data = storage->mapping->get_addr<const char>();
+    if(std::memcmp(data, membershipindex::magic, sizeof(membershipindex::magic))) {
+      throw std::runtime_error("'" + idx_file + "' is not a membership index file");
+    }
+    const uint64_t* header = reinterpret_cast<const uint64_t*>(data + sizeof(membershipindex::magic));
+    if(header[0] != blockindex::fileSize(mFilename)) {
+      throw std::runtime_error("membership index '" + idx_file + "' is out of date, rebuild it");
+    }
+    uint64_t count = 0;
+    for(int t = 0; t < membershipindex::num_tables; ++t) {
+      count += header[1 + t];
+    }
+    if(idx_size != header_size + count * sizeof(entry_type)) {
+      throw std::runtime_error("membership index file '" + idx_file + "' is truncated");
+    }
+    const entry_type* entries = reinterpret_cast<const entry_type*>(data + header_size);
+    membershipindex::TableView tables[membershipindex::num_tables];
+    for(int t = 0; t < membershipindex::num_tables; ++t) {
+      tables[t].first = entries;
+      tables[t].last = entries + header[1 + t];
+      entries = tables[t].last;
+    }
+    std::copy(tables, tables + membershipindex::num_tables, mTables);
+    mStorage = storage;
+    mFileSize = header[0];
+  }
+
+  // The table with the memberships of member_type objects in parent_type
+  // objects
+  static membershipindex::Table table(osmium::item_type member_type, osmium::item_type parent_type) {
+    if(member_type == osmium::item_type::node && parent_type == osmium::item_type::way) {
+      return membershipindex::node_way;
+    } else if(member_type == osmium::item_type::node && parent_type == osmium::item_type::relation) {
+      return membershipindex::node_relation;
+    } else if(member_type == osmium::item_type::way && parent_type == osmium::item_type::relation) {
+      return membershipindex::way_relation;
+    } else if(member_type == osmium::item_type::relation && parent_type == osmium::item_type::relation) {
+      return membershipindex::relation_relation;
+    }
+    throw std::invalid_argument("memberships are only indexed for nodes in ways and for nodes, ways and relations in relations");
+  }
+
+  // All (member, parent) pairs of the given members, sorted by member id
+  std::vector<entry_type> parents(std::vector<osmium::unsigned_object_id_type> ids, membershipindex::Table table) const {
+    std::sort(ids.begin(), ids.end());
+    const membershipindex::TableView& view = mTables[table];
+    std::vector<entry_type> ret;
+    osmium::index::detail::for_each_sorted_match(view.first, view.last, ids.begin(), ids.end(), [&ret](const entry_type& entry) {
+      ret.push_back(entry);
+    });
+    return ret;
+  }
+
+private:
+  std::string mFilename;
+  uint64_t mFileSize = 0;
+  std::shared_ptr<membershipindex::Storage> mStorage;
+  membershipindex::TableView mTables[membershipindex::num_tables];
+};
+
+#endif // MEMBERSHIPINDEX_HPP
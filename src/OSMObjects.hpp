@@ -21,6 +21,9 @@
 #define OSMOBJECTS_HPP
 
 #include <Rcpp.h>
+#include <memory>
+#include <string>
+#include <vector>
 #include <osmium/osm/object.hpp>
 #include <osmium/osm/node.hpp>
 #include <osmium/osm/way.hpp>
@@ -28,6 +31,9 @@
 #include <osmium/osm/area.hpp>
 #include <osmium/geom/factory.hpp>
 #include <osmium/geom/wkb.hpp>
+#include <osmium/io/file.hpp>
+
+#include "StringCache.hpp"
 
 //Rcpp::NumericVector getLocation(const Rcpp::XPtr<const osmium::Node>& node) {
 //  osmium::Location loc = node->location();
@@ -63,6 +69,22 @@ public:
     }
   } 
   
+  // Only the tags with the given keys are converted, as a character vector
+  // named by the keys (NA if an object has no such tag)
+  void setTagKeys(const std::vector<std::string>& keys) {
+    mTagKeys = std::make_shared<std::vector<std::string>>(keys);
+    mTagNames = Rcpp::wrap(keys);
+  }
+  
+  // The keys of the tags needed for the conversion, nullptr if all tags
+  // are needed
+  osmium::io::tag_keys_type neededTagKeys() const {
+    if(!mIncludeTags) {
+      return std::make_shared<std::vector<std::string>>();
+    }
+    return mTagKeys;
+  }
+  
   Rcpp::List createRNode(const osmium::Node& node) {
     Rcpp::List ret(4);
     
@@ -134,19 +156,35 @@ private:
   bool mIncludeLocation = false;
   bool mIncludeNodeRefs = false;
   bool mIncludeMembers = false;
+  std::shared_ptr<std::vector<std::string>> mTagKeys = nullptr;
+  Rcpp::CharacterVector mTagNames;
+  // keys, values and roles converted during the run
+  StringCache mStrings;
 
   Rcpp::CharacterVector getId(const osmium::OSMObject& obj) {
     return Rcpp::CharacterVector::create(std::to_string(obj.id()));
   }
   
-  Rcpp::CharacterMatrix getTags(const osmium::OSMObject& obj) {
+  SEXP getTags(const osmium::OSMObject& obj) {
     const osmium::TagList& tags = obj.tags();
+    if(mTagKeys != nullptr) {
+      Rcpp::CharacterVector ret(mTagKeys->size());
+      std::fill(ret.begin(), ret.end(), Rcpp::CharacterVector::get_na());
+      for(size_t i = 0; i < mTagKeys->size(); ++i) {
+        const char* value = tags.get_value_by_key((*mTagKeys)[i].c_str());
+        if(value != nullptr) {
+          SET_STRING_ELT(ret, i, mStrings.get(value));
+        }
+      }
+      ret.attr("names") = mTagNames;
+      return ret;
+    }
     Rcpp::CharacterMatrix ret(tags.size(), 2);
     colnames(ret) = Rcpp::CharacterVector::create("key","value");
     int row = 0;
     for(auto it = tags.cbegin(); it != tags.cend(); ++it) {
-      ret(row, 0) = Rcpp::String(it->key());
-      ret(row, 1) = Rcpp::String(it->value());
+      SET_STRING_ELT(ret, row, mStrings.get(it->key()));
+      SET_STRING_ELT(ret, row + ret.nrow(), mStrings.get(it->value()));
       row++;
     } 
     return ret;
@@ -188,13 +226,13 @@ private:
     int row = 0;
     for(const osmium::RelationMember& rm : members) {
       if(rm.type() == osmium::item_type::way) {
-        ret(row, 0) = "way";
+        SET_STRING_ELT(ret, row, mStrings.get("way"));
       } else if (rm.type() == osmium::item_type::node) {
-        ret(row, 0) = "node";
+        SET_STRING_ELT(ret, row, mStrings.get("node"));
       } else if (rm.type() == osmium::item_type::relation) {
-        ret(row, 0) = "relation";
+        SET_STRING_ELT(ret, row, mStrings.get("relation"));
       }
-      ret(row, 1) = rm.role();
+      SET_STRING_ELT(ret, row + ret.nrow(), mStrings.get(rm.role()));
       row_names[row] = std::to_string(rm.ref());
       row++; 
     }
@@ -0,0 +1,138 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <osmium/handler.hpp>
+#include <osmium/util/profile.hpp>
+
+namespace profile {
+
+struct StageRow {
+  std::string name;
+  double seconds;
+  uint64_t calls;
+  uint64_t items;
+  uint64_t bytes;
+};
+
+struct QueueRow {
+  std::string name;
+  osmium::util::Profile::QueueStats stats;
+};
+
+// Timings of the stages and statistics of the queues of one profiled run
+struct Report {
+  std::vector<StageRow> stages;
+  std::vector<QueueRow> queues;
+};
+
+inline Report snapshot() {
+  Report report;
+  const osmium::util::Profile& profile = osmium::util::Profile::instance();
+  profile.for_each_stage([&report](const std::string& name, const osmium::util::Profile::Stage& stage) {
+    report.stages.push_back(StageRow { name, stage.seconds(), stage.calls(), stage.items(), stage.bytes() });
+  });
+  profile.for_each_queue([&report](const std::string& name, const osmium::util::Profile::QueueStats& stats) {
+    report.queues.push_back(QueueRow { name, stats });
+  });
+  return report;
+}
+
+} // namespace profile
+
+// Profiles one run if enabled: resets the global profile on construction and
+// stores its snapshot in the report on destruction. Has to be declared before
+// the readers and writers of the run, so their queues are already destroyed
+// (and counted) when the snapshot is taken.
+class ProfileSession {
+public:
+  ProfileSession(bool enabled, profile::Report& report) : mEnabled(enabled), mReport(report) {
+    if(mEnabled) {
+      osmium::util::Profile::instance().reset();
+      osmium::util::Profile::instance().enable();
+    }
+  }
+
+  ProfileSession(const ProfileSession&) = delete;
+  ProfileSession& operator=(const ProfileSession&) = delete;
+
+  ~ProfileSession() {
+    if(mEnabled) {
+      osmium::util::Profile::instance().enable(false);
+      try {
+        mReport = profile::snapshot();
+      } catch(...) {
+        // the run itself succeeded or failed independently of its profile
+      }
+    }
+  }
+
+private:
+  bool mEnabled;
+  profile::Report& mReport;
+};
+
+// Handler adding the time spent in another handler to a stage of the profile
+template <typename THandler>
+class ProfiledHandler : public osmium::handler::Handler {
+public:
+  ProfiledHandler(THandler& handler, const char* stage) :
+    mHandler(handler),
+    mStage(osmium::util::Profile::instance().stage(stage)) {
+  }
+
+  template <typename T>
+  void node(T& node) {
+    osmium::util::ProfileTimer timer(mStage);
+    mHandler.node(node);
+  }
+
+  template <typename T>
+  void way(T& way) {
+    osmium::util::ProfileTimer timer(mStage);
+    mHandler.way(way);
+  }
+
+  template <typename T>
+  void relation(T& relation) {
+    osmium::util::ProfileTimer timer(mStage);
+    mHandler.relation(relation);
+  }
+
+  template <typename T>
+  void area(T& area) {
+    osmium::util::ProfileTimer timer(mStage);
+    mHandler.area(area);
+  }
+
+  void flush() {
+    mHandler.flush();
+  }
+
+private:
+  THandler& mHandler;
+  osmium::util::Profile::Stage* mStage;
+};
+
+#endif // PROFILE_HPP
@@ -0,0 +1,74 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef STRINGCACHE_HPP
+#define STRINGCACHE_HPP
+
+#include <Rcpp.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Cache of the CHARSXPs of strings converted to R during a run. Tag keys and
+// frequent values are looked up in R's global CHARSXP cache only once. The
+// cached CHARSXPs are protected by blocks of character vectors. When the
+// cache is full, further strings are created without caching, so unique
+// values (e.g. names) can't let it grow without limit.
+class StringCache {
+public:
+  
+  StringCache(size_t max_size = 1 << 18) : mMaxSize(max_size) {
+  }
+  
+  SEXP get(const char* str) {
+    mKey.assign(str);
+    auto it = mStrings.find(mKey);
+    if(it != mStrings.end()) {
+      return it->second;
+    }
+    if(mStrings.size() >= mMaxSize) {
+      return Rf_mkCharCE(str, CE_UTF8);
+    }
+    // the block is allocated first, the new CHARSXP is unprotected until
+    // it is stored
+    if(mStrings.size() % block_size == 0) {
+      mBlocks.push_back(Rcpp::CharacterVector(block_size));
+    }
+    SEXP ret = Rf_mkCharCE(str, CE_UTF8);
+    SET_STRING_ELT(mBlocks.back(), mStrings.size() % block_size, ret);
+    mStrings.emplace(mKey, ret);
+    return ret;
+  }
+  
+  size_t size() const {
+    return mStrings.size();
+  }
+  
+private:
+  enum { block_size = 4096 };
+  
+  size_t mMaxSize;
+  std::unordered_map<std::string, SEXP> mStrings;
+  std::vector<Rcpp::CharacterVector> mBlocks;
+  // avoids an allocation per lookup
+  std::string mKey;
+};
+
+#endif // STRINGCACHE_HPP
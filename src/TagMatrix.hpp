@@ -0,0 +1,373 @@
+
+// Rosmium: R bindings for the Osmium library
+// Copyright (C) 2015,2016 Lukas Huwiler
+//
+// This file is part of Rosmium.
+//
+// Rosmium is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Rosmium is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Rosmium.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TAGMATRIX_HPP
+#define TAGMATRIX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/item_type.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/tag.hpp>
+#include <osmium/thread/pool.hpp>
+
+#include "BlockIndex.hpp"
+
+namespace tagmatrix {
+
+typedef std::unordered_map<std::string, uint64_t> feature_counts_type;
+
+// Features are tag keys ("highway") or tags ("highway=primary")
+inline void featureName(const osmium::Tag& tag, std::string& name) {
+  name.assign(tag.key());
+  name += '=';
+  name += tag.value();
+}
+
+// Columns of the matrix by feature name
+class Vocabulary {
+public:
+
+  void add(const std::string& feature, bool is_tag) {
+    if(mColumns.emplace(feature, static_cast<int>(mNames.size())).second) {
+      mNames.push_back(feature);
+      if(is_tag) {
+        mWithValues = true;
+      } else {
+        mWithKeys = true;
+      }
+    }
+  }
+
+  // Column of the feature or -1
+  int column(const std::string& feature) const {
+    auto it = mColumns.find(feature);
+    return it == mColumns.end() ? -1 : it->second;
+  }
+
+  bool withKeys() const {
+    return mWithKeys;
+  }
+
+  bool withValues() const {
+    return mWithValues;
+  }
+
+  size_t size() const {
+    return mNames.size();
+  }
+
+  const std::vector<std::string>& names() const {
+    return mNames;
+  }
+
+private:
+  std::unordered_map<std::string, int> mColumns;
+  std::vector<std::string> mNames;
+  bool mWithKeys = false;
+  bool mWithValues = false;
+};
+
+// Objects of one buffer with the columns of their features, row by row
+struct RowBlock {
+  std::vector<osmium::object_id_type> ids;
+  std::vector<osmium::item_type> types;
+  std::vector<osmium::Location> locations;
+  std::vector<size_t> rowStart;
+  std::vector<int> columns;
+};
+
+// Counts the features of the objects of one buffer on a pool thread
+class CountTask {
+public:
+  CountTask(std::shared_ptr<osmium::memory::Buffer> buffer, bool with_values) :
+    mBuffer(buffer), mWithValues(with_values) {
+  }
+
+  feature_counts_type operator()() {
+    feature_counts_type counts;
+    std::string name;
+    for(auto it = mBuffer->cbegin<osmium::OSMObject>(); it != mBuffer->cend<osmium::OSMObject>(); ++it) {
+      for(const osmium::Tag& tag : it->tags()) {
+        if(mWithValues) {
+          featureName(tag, name);
+          ++counts[name];
+        } else {
+          ++counts[tag.key()];
+        }
+      }
+    }
+    return counts;
+  }
+
+private:
+  std::shared_ptr<osmium::memory::Buffer> mBuffer;
+  bool mWithValues;
+};
+
+// Looks up the features of the objects of one buffer on a pool thread
+class RowTask {
+public:
+  RowTask(std::shared_ptr<osmium::memory::Buffer> buffer, std::shared_ptr<const Vocabulary> vocabulary) :
+    mBuffer(buffer), mVocabulary(vocabulary) {
+  }
+
+  RowBlock operator()() {
+    RowBlock block;
+    std::string name;
+    for(auto it = mBuffer->cbegin<osmium::OSMObject>(); it != mBuffer->cend<osmium::OSMObject>(); ++it) {
+      block.ids.push_back(it->id());
+      block.types.push_back(it->type());
+      block.locations.push_back(it->type() == osmium::item_type::node ? static_cast<const osmium::Node&>(*it).location() : osmium::Location());
+      block.rowStart.push_back(block.columns.size());
+      for(const osmium::Tag& tag : it->tags()) {
+        if(mVocabulary->withKeys()) {
+          name.assign(tag.key());
+          addColumn(name, block);
+        }
+        if(mVocabulary->withValues()) {
+          featureName(tag, name);
+          addColumn(name, block);
+        }
+      }
+      // a key may be repeated in the tags, but a row has every column once
+      std::sort(block.columns.begin() + block.rowStart.back(), block.columns.end());
+      block.columns.erase(std::unique(block.columns.begin() + block.rowStart.back(), block.columns.end()), block.columns.end());
+    }
+    return block;
+  }
+
+private:
+
+  void addColumn(const std::string& name, RowBlock& block) {
+    int column = mVocabulary->column(name);
+    if(column >= 0) {
+      block.columns.push_back(column);
+    }
+  }
+
+  std::shared_ptr<osmium::memory::Buffer> mBuffer;
+  std::shared_ptr<const Vocabulary> mVocabulary;
+};
+
+} // namespace tagmatrix
+
+// Builds a sparse object x feature matrix from the tags of the added objects.
+// The objects are collected into buffers which are processed on the osmium
+// pool. Without a given vocabulary, the features are learned with a counting
+// pass over the same objects first (see learnVocabulary()).
+//
+// The matrix is returned in compressed sparse column form as used by
+// Matrix::dgCMatrix: for column j, i[p[j]] to i[p[j + 1] - 1] are the
+// (0-based) rows having the feature. Rows are in the order the objects were
+// added.
+class TagMatrixBuilder {
+public:
+
+  static const size_t max_buffer_size = 1024 * 1024;
+
+  TagMatrixBuilder(bool with_values) : mWithValues(with_values) {
+    mVocabulary = std::make_shared<tagmatrix::Vocabulary>();
+    newBuffer();
+  }
+
+  // Sets the columns of the matrix. Features with a '=' are tags, the other
+  // features are tag keys.
+  void setVocabulary(const std::vector<std::string>& features) {
+    auto vocabulary = std::make_shared<tagmatrix::Vocabulary>();
+    for(const auto& feature : features) {
+      vocabulary->add(feature, feature.find('=') != std::string::npos);
+    }
+    mVocabulary = vocabulary;
+  }
+
+  // Switches to the counting pass
+  void startCounting() {
+    mCounting = true;
+    mCounts.clear();
+  }
+
+  // Ends the counting pass and uses the features occurring at least
+  // min_count times as columns, the most frequent feature first
+  void learnVocabulary(uint64_t min_count) {
+    flush();
+    mCounting = false;
+    std::vector<std::pair<std::string, uint64_t>> counts;
+    for(const auto& count : mCounts) {
+      if(count.second >= min_count) {
+        counts.push_back(count);
+      }
+    }
+    mCounts.clear();
+    std::sort(counts.begin(), counts.end(), [](const std::pair<std::string, uint64_t>& a, const std::pair<std::string, uint64_t>& b) {
+      return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+    auto vocabulary = std::make_shared<tagmatrix::Vocabulary>();
+    for(const auto& count : counts) {
+      vocabulary->add(count.first, mWithValues);
+    }
+    mVocabulary = vocabulary;
+  }
+
+  // Removes the rows of a previous run, keeps the vocabulary
+  void clearRows() {
+    mIds.clear();
+    mTypes.clear();
+    mLocations.clear();
+    mRowStart.clear();
+    mColumns.clear();
+  }
+
+  void add(const osmium::OSMObject& obj) {
+    mBuffer->add_item(obj);
+    mBuffer->commit();
+    if(mBuffer->committed() > max_buffer_size) {
+      submit();
+    }
+  }
+
+  // Waits for all submitted buffers
+  void flush() {
+    submit();
+    while(!mPendingCounts.empty()) {
+      mergeCounts();
+    }
+    while(!mPendingRows.empty()) {
+      mergeRows();
+    }
+  }
+
+  size_t rows() const {
+    return mIds.size();
+  }
+
+  size_t nonZeros() const {
+    return mColumns.size();
+  }
+
+  const std::vector<std::string>& features() const {
+    return mVocabulary->names();
+  }
+
+  const std::vector<osmium::object_id_type>& ids() const {
+    return mIds;
+  }
+
+  const std::vector<osmium::item_type>& types() const {
+    return mTypes;
+  }
+
+  const std::vector<osmium::Location>& locations() const {
+    return mLocations;
+  }
+
+  // Converts the collected rows into column form: p has one entry per column
+  // and one more, i one entry per non-zero element
+  template <typename TP, typename TI>
+  void columnForm(TP& p, TI& i) const {
+    const size_t ncol = mVocabulary->size();
+    std::vector<size_t> next(ncol + 1, 0);
+    for(int column : mColumns) {
+      ++next[column + 1];
+    }
+    for(size_t j = 0; j < ncol; ++j) {
+      next[j + 1] += next[j];
+    }
+    for(size_t j = 0; j <= ncol; ++j) {
+      p[j] = next[j];
+    }
+    // rows are visited in ascending order, so the rows of each column are
+    // sorted as required
+    for(size_t row = 0; row < mRowStart.size(); ++row) {
+      size_t last = row + 1 < mRowStart.size() ? mRowStart[row + 1] : mColumns.size();
+      for(size_t k = mRowStart[row]; k < last; ++k) {
+        i[next[mColumns[k]]++] = row;
+      }
+    }
+  }
+
+private:
+
+  void newBuffer() {
+    mBuffer.reset(new osmium::memory::Buffer(max_buffer_size, osmium::memory::Buffer::auto_grow::yes));
+  }
+
+  void submit() {
+    if(mBuffer->committed() == 0) {
+      return;
+    }
+    if(mCounting) {
+      mPendingCounts.push_back(osmium::thread::Pool::instance().submit(tagmatrix::CountTask(mBuffer, mWithValues)));
+      if(mPendingCounts.size() > blockindex::max_pending) {
+        mergeCounts();
+      }
+    } else {
+      mPendingRows.push_back(osmium::thread::Pool::instance().submit(tagmatrix::RowTask(mBuffer, mVocabulary)));
+      if(mPendingRows.size() > blockindex::max_pending) {
+        mergeRows();
+      }
+    }
+    newBuffer();
+  }
+
+  void mergeCounts() {
+    tagmatrix::feature_counts_type counts = mPendingCounts.front().get();
+    mPendingCounts.pop_front();
+    for(const auto& count : counts) {
+      mCounts[count.first] += count.second;
+    }
+  }
+
+  void mergeRows() {
+    tagmatrix::RowBlock block = mPendingRows.front().get();
+    mPendingRows.pop_front();
+    const size_t offset = mColumns.size();
+    mIds.insert(mIds.end(), block.ids.begin(), block.ids.end());
+    mTypes.insert(mTypes.end(), block.types.begin(), block.types.end());
+    mLocations.insert(mLocations.end(), block.locations.begin(), block.locations.end());
+    for(size_t start : block.rowStart) {
+      mRowStart.push_back(offset + start);
+    }
+    mColumns.insert(mColumns.end(), block.columns.begin(), block.columns.end());
+  }
+
+  bool mWithValues;
+  bool mCounting = false;
+  std::shared_ptr<const tagmatrix::Vocabulary> mVocabulary;
+  std::shared_ptr<osmium::memory::Buffer> mBuffer;
+  std::deque<std::future<tagmatrix::feature_counts_type>> mPendingCounts;
+  std::deque<std::future<tagmatrix::RowBlock>> mPendingRows;
+  tagmatrix::feature_counts_type mCounts;
+  std::vector<osmium::object_id_type> mIds;
+  std::vector<osmium::item_type> mTypes;
+  std::vector<osmium::Location> mLocations;
+  std::vector<size_t> mRowStart;
+  std::vector<int> mColumns;
+};
+
+#endif // TAGMATRIX_HPP
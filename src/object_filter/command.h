@@ -38,19 +38,24 @@
 #include <memory>
 #include <regex>
 #include <limits>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
 #include <unordered_set>
 #include <osmium/osm/object.hpp>
 #include <osmium/osm/node.hpp>
 #include <osmium/osm/way.hpp>
 #include <osmium/osm/relation.hpp>
+#include <osmium/osm/entity_bits.hpp>
 #include <osmium/geom/haversine.hpp>
+#include <osmium/io/tag_condition.hpp>
 //#include <osmium/osm/tag.hpp>
 
 namespace tagfilter {
 
 class NumericCommand {
 public:
-  virtual std::shared_ptr<double> execute(const osmium::OSMObject& obj) = 0;
+  virtual std::shared_ptr<double> execute(const osmium::OSMObject& obj) const = 0;
 };
 
 class NumericIdentity : public NumericCommand {
@@ -60,7 +65,7 @@ public:
     mValue = std::make_shared<double>(val);
   } 
   
-  std::shared_ptr<double> execute(const osmium::OSMObject& obj) {
+  std::shared_ptr<double> execute(const osmium::OSMObject& obj) const {
     return mValue;
   }
   
@@ -75,7 +80,7 @@ public:
     mLocation = loc; 
   } 
   
-  std::shared_ptr<double> execute(const osmium::OSMObject& obj) {
+  std::shared_ptr<double> execute(const osmium::OSMObject& obj) const {
     if(obj.type() == osmium::item_type::node) {
       const osmium::Node& node = static_cast<const osmium::Node&>(obj);
       double res = osmium::geom::haversine::distance(node.location(), mLocation);
@@ -88,18 +93,101 @@ private:
   osmium::Location mLocation; 
 };
 
-class Command {
+class Command;
+class CommandIdSet;
+
+// Per run state of a filter. Commands don't change after construction, so
+// a filter can be evaluated by several handlers or threads at once, each
+// with its own state. Only bounding boxes have state: the ids of the objects
+// within the box so far, which the ways and relations read later refer to.
+class FilterState {
 public:
-  virtual bool execute(const osmium::OSMObject& obj) = 0;
+  typedef std::unordered_set<osmium::object_id_type> IdSet;
+  
+  // Ids of the nodes, ways and relations (see entitySlot) within a box
+  struct BoxIds {
+    IdSet ids[3];
+  };
   
-  virtual void clear() {
+  BoxIds& boxIds(const Command* box) {
+    return mBoxes[box];
   }
   
+  void clear() {
+    mBoxes.clear();
+  }
+  
+private:
+  std::unordered_map<const Command*, BoxIds> mBoxes;
+};
+
+class Command {
+public:
+  virtual bool execute(const osmium::OSMObject& obj, FilterState& state) const = 0;
+  
+  // True if the result depends on the objects evaluated before (with the
+  // same state), i.e. all entities have to be read in order
   virtual bool requiresAllEntities() {
     return false; 
   }
+  
+  // Returns an equivalent but cheaper command or nullptr if the command
+  // can't be simplified (children may be replaced in place).
+  virtual std::shared_ptr<Command> simplify() {
+    return nullptr;
+  }
+  
+  // Adds the ids matched by the command to the set. Returns false if the 
+  // command is not a pure id comparison.
+  virtual bool collectIds(CommandIdSet& ids) {
+    return false;
+  }
+  
+  // Entity types which can fulfill the condition
+  virtual osmium::osm_entity_bits::type entities() {
+    return osmium::osm_entity_bits::nwra;
+  }
+  
+  // Only valid for input sorted by type and id: true if no object following
+  // obj can fulfill the condition.
+  virtual bool exhausted(const osmium::OSMObject& obj) {
+    return false;
+  }
+  
+  // Adds a condition on the tags to cond which every object fulfilling the
+  // command fulfills, so the decoder can drop the other objects. exact is
+  // set if the condition is equivalent to the command. Returns the node of
+  // the condition or -1 if the command doesn't restrict the tags.
+  virtual osmium::io::TagCondition::node_id tagCondition(osmium::io::TagCondition& cond, bool& exact) {
+    exact = false;
+    return -1;
+  }
 };
 
+inline void simplifyCommand(std::shared_ptr<Command>& cmd) {
+  std::shared_ptr<Command> simplified = cmd->simplify();
+  if(simplified != nullptr) {
+    cmd = simplified;
+  }
+}
+
+// Index of nodes, ways and relations in per entity type arrays 
+inline int entitySlot(osmium::item_type type) {
+  switch(type) {
+  case osmium::item_type::node:
+    return 0;
+  case osmium::item_type::way:
+    return 1;
+  case osmium::item_type::relation:
+    return 2;
+  default:
+    return -1;
+  }
+}
+
+// Objects within the box: nodes located in it, ways with a node within the
+// box and relations with a member within the box. Ways and relations can
+// only refer to the objects evaluated before with the same state.
 class CommandBoundingBox : public Command {
 public:
   
@@ -108,63 +196,55 @@ public:
     mMaxLon = max_lon;
     mMinLat = min_lat;
     mMaxLat = max_lat;
-    mNodesWithinBox = std::make_shared<std::unordered_set<osmium::object_id_type>>();
-    mWaysWithinBox = std::make_shared<std::unordered_set<osmium::object_id_type>>();
-    mRelationsWithinBox = std::make_shared<std::unordered_set<osmium::object_id_type>>();
   } 
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
+    FilterState::BoxIds& within = state.boxIds(this);
     bool ret = false;
     switch(obj.type()) {
     case osmium::item_type::node:
       {
         const osmium::Node& node = static_cast<const osmium::Node&>(obj);
-        ret = isNodeWithinBox(node);
+        ret = isNodeWithinBox(node, within);
         break;
       }
     case osmium::item_type::way:
       {
         const osmium::Way& way = static_cast<const osmium::Way&>(obj);
-        ret = isWayWithinBox(way);
+        ret = isWayWithinBox(way, within);
         break;
       }
     case osmium::item_type::relation:
       {
         const osmium::Relation& rel = static_cast<const osmium::Relation&>(obj);
-        ret = isRelationWithinBox(rel);
+        ret = isRelationWithinBox(rel, within);
         break;
       }
     }
     return ret;
   } 
   
-  void clear() {
-    mNodesWithinBox->clear();
-    mWaysWithinBox->clear();
-    mRelationsWithinBox->clear();
-  }
-  
   bool requiresAllEntities() {
     return true;
   }
   
 private:
   
-  bool isNodeWithinBox(const osmium::Node& node) {
+  bool isNodeWithinBox(const osmium::Node& node, FilterState::BoxIds& within) const {
       bool within_lon = node.location().lon() <= mMaxLon && node.location().lon() >= mMinLon;
       bool within_lat = node.location().lat() <= mMaxLat && node.location().lat() >= mMinLat;
-      bool within = within_lon && within_lat; 
-      if(within) {
-        mNodesWithinBox->insert(node.id());
+      bool ret = within_lon && within_lat; 
+      if(ret) {
+        within.ids[0].insert(node.id());
       }   
-      return within;
+      return ret;
   } 
   
-  bool isWayWithinBox(const osmium::Way& way) {
+  bool isWayWithinBox(const osmium::Way& way, FilterState::BoxIds& within) const {
     bool ret = false;
     for(const osmium::NodeRef& nr : way.nodes()) {
-      if(mNodesWithinBox->count(nr.ref()) > 0) {
-        mWaysWithinBox->insert(way.id());
+      if(within.ids[0].count(nr.ref()) > 0) {
+        within.ids[1].insert(way.id());
         ret = true;      
         break;
       }
@@ -172,34 +252,13 @@ private:
     return ret;
   }
   
-  bool isRelationWithinBox(const osmium::Relation& rel) {
+  bool isRelationWithinBox(const osmium::Relation& rel, FilterState::BoxIds& within) const {
     bool ret = false; 
     for(const osmium::RelationMember& rm : rel.members()) {
-      switch(rm.type()) {
-      case osmium::item_type::node:
-        {
-          if(mNodesWithinBox->count(rm.ref()) > 0) {
-            ret = true;
-          }
-          break;
-        }
-      case osmium::item_type::way:
-        {
-          if(mWaysWithinBox->count(rm.ref()) > 0) {
-            ret = true;
-          }
-          break;
-        }
-      case osmium::item_type::relation:
-        {
-          if(mRelationsWithinBox->count(rm.ref()) > 0) {
-            ret = true;
-          }
-          break;
-        }
-      }
-      if(ret) {
-        mRelationsWithinBox->insert(rel.id());
+      int slot = entitySlot(rm.type());
+      if(slot >= 0 && within.ids[slot].count(rm.ref()) > 0) {
+        within.ids[2].insert(rel.id());
+        ret = true;
         break;
       }
     }
@@ -210,9 +269,6 @@ private:
   double mMaxLat;
   double mMinLon;
   double mMaxLon;
-  std::shared_ptr<std::unordered_set<osmium::object_id_type>> mNodesWithinBox;
-  std::shared_ptr<std::unordered_set<osmium::object_id_type>> mWaysWithinBox;
-  std::shared_ptr<std::unordered_set<osmium::object_id_type>> mRelationsWithinBox; 
 };
 
 class CommandCompareId : public Command {
@@ -223,18 +279,136 @@ public:
     mId = id; 
   } 
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
     if(obj.id() == mId && obj.type() == mItemType) {
       return true; 
     }
     return false;
   } 
   
+  bool collectIds(CommandIdSet& ids);
+  
+  osmium::osm_entity_bits::type entities() {
+    return osmium::osm_entity_bits::from_item_type(mItemType);
+  }
+  
+  bool exhausted(const osmium::OSMObject& obj) {
+    int slot = entitySlot(obj.type());
+    return slot > entitySlot(mItemType) || (obj.type() == mItemType && obj.id() > 0 && obj.id() > mId);
+  }
+  
 private:
   osmium::item_type mItemType;
   osmium::object_id_type mId; 
 };
 
+// Lookup of many ids per entity type. Dense id ranges are stored as bitmap,
+// sparse ones as sorted vector searched without data dependent branches.
+class CommandIdSet : public Command {
+
+public:
+  void add(osmium::object_id_type id, osmium::item_type item_type) {
+    int slot = entitySlot(item_type);
+    if(slot >= 0) {
+      mLookups[slot].ids.push_back(id);
+    }
+  }
+  
+  // Has to be called after the last call of add()
+  void finalize() {
+    for(IdLookup& lookup : mLookups) {
+      lookup.finalize();
+    }
+  }
+  
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
+    int slot = entitySlot(obj.type());
+    return slot >= 0 && mLookups[slot].contains(obj.id());
+  }
+  
+  bool collectIds(CommandIdSet& ids) {
+    for(int slot = 0; slot < 3; ++slot) {
+      std::vector<osmium::object_id_type>& target = ids.mLookups[slot].ids;
+      target.insert(target.end(), mLookups[slot].ids.begin(), mLookups[slot].ids.end());
+    }
+    return true;
+  }
+  
+  osmium::osm_entity_bits::type entities() {
+    osmium::osm_entity_bits::type ret = osmium::osm_entity_bits::nothing;
+    if(!mLookups[0].ids.empty()) ret |= osmium::osm_entity_bits::node;
+    if(!mLookups[1].ids.empty()) ret |= osmium::osm_entity_bits::way;
+    if(!mLookups[2].ids.empty()) ret |= osmium::osm_entity_bits::relation;
+    return ret;
+  }
+  
+  bool exhausted(const osmium::OSMObject& obj) {
+    int slot = entitySlot(obj.type());
+    if(slot < 0) {
+      return false;
+    }
+    for(int later = slot + 1; later < 3; ++later) {
+      if(!mLookups[later].ids.empty()) {
+        return false;
+      }
+    }
+    const IdLookup& lookup = mLookups[slot];
+    return lookup.ids.empty() || (obj.id() > 0 && obj.id() > lookup.ids.back());
+  }
+  
+private:
+  
+  struct IdLookup {
+    std::vector<osmium::object_id_type> ids;
+    std::vector<uint64_t> bitmap;
+    osmium::object_id_type min = 0;
+    
+    void finalize() {
+      std::sort(ids.begin(), ids.end());
+      ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+      bitmap.clear();
+      if(ids.empty()) {
+        return;
+      }
+      min = ids.front();
+      // a bitmap doesn't need more memory than the sorted vector
+      uint64_t range = static_cast<uint64_t>(ids.back() - min) + 1;
+      if(range / 64 <= ids.size()) {
+        bitmap.resize(range / 64 + 1, 0);
+        for(osmium::object_id_type id : ids) {
+          uint64_t pos = static_cast<uint64_t>(id - min);
+          bitmap[pos / 64] |= uint64_t(1) << (pos % 64);
+        }
+      }
+    }
+    
+    bool contains(osmium::object_id_type id) const {
+      if(!bitmap.empty()) {
+        uint64_t pos = static_cast<uint64_t>(id - min);
+        return pos < bitmap.size() * 64 && ((bitmap[pos / 64] >> (pos % 64)) & 1);
+      }
+      size_t n = ids.size();
+      if(n == 0) {
+        return false;
+      }
+      const osmium::object_id_type* base = ids.data();
+      while(n > 1) {
+        size_t half = n / 2;
+        base = (base[half] <= id) ? base + half : base;
+        n -= half;
+      }
+      return *base == id;
+    }
+  };
+  
+  IdLookup mLookups[3];
+};
+
+inline bool CommandCompareId::collectIds(CommandIdSet& ids) {
+  ids.add(mId, mItemType);
+  return true;
+}
+
 class CommandEqualValue : public Command {
 
 public:
@@ -242,15 +416,24 @@ public:
 		mComparisonValue = val;
 	}
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
     return std::any_of(obj.tags().cbegin(), obj.tags().cend(), [this](const osmium::Tag& t) {
       return executeSingleTag(t);
     });
   }
   
-  bool executeSingleTag(const osmium::Tag& tag) {
+  bool executeSingleTag(const osmium::Tag& tag) const {
     return tag.value() == mComparisonValue; 
   }
+  
+  const std::string& getValue() const {
+    return mComparisonValue;
+  }
+  
+  osmium::io::TagCondition::node_id tagCondition(osmium::io::TagCondition& cond, bool& exact) {
+    exact = true;
+    return cond.value(mComparisonValue);
+  }
 
 private:
 	std::string mComparisonValue;
@@ -264,15 +447,24 @@ public:
 		mComparisonKey = key;
 	}
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
     return std::any_of(obj.tags().cbegin(), obj.tags().cend(), [this](const osmium::Tag& t) {
       return executeSingleTag(t);
     });
   }
   
-  bool executeSingleTag(const osmium::Tag& tag) {
+  bool executeSingleTag(const osmium::Tag& tag) const {
     return tag.key() == mComparisonKey;
   }
+  
+  const std::string& getKey() const {
+    return mComparisonKey;
+  }
+  
+  osmium::io::TagCondition::node_id tagCondition(osmium::io::TagCondition& cond, bool& exact) {
+    exact = true;
+    return cond.key(mComparisonKey);
+  }
 
 private:
 	std::string mComparisonKey;
@@ -283,16 +475,23 @@ class CommandMatchesValue : public Command {
 public:
 	CommandMatchesValue(std::string pattern) {
 		mPattern = std::regex(pattern);
+		mPatternString = pattern;
 	}
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
     return std::any_of(obj.tags().cbegin(), obj.tags().cend(), [this](const osmium::Tag& t) {
       return std::regex_match(t.value(), mPattern);
     });
   }
+  
+  osmium::io::TagCondition::node_id tagCondition(osmium::io::TagCondition& cond, bool& exact) {
+    exact = true;
+    return cond.value_regex(mPatternString);
+  }
 
 private:
 	std::regex mPattern;
+	std::string mPatternString;
 
 };
 
@@ -301,16 +500,23 @@ class CommandMatchesKey : public Command {
 public:
 	CommandMatchesKey(std::string pattern) {
 		mPattern = std::regex(pattern);
+		mPatternString = pattern;
 	}
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
     return std::any_of(obj.tags().cbegin(), obj.tags().cend(), [this](const osmium::Tag& t) {
       return std::regex_match(t.key(), mPattern);
     });
   }
+  
+  osmium::io::TagCondition::node_id tagCondition(osmium::io::TagCondition& cond, bool& exact) {
+    exact = true;
+    return cond.key_regex(mPatternString);
+  }
 
 private:
 	std::regex mPattern;
+	std::string mPatternString;
 
 };
 
@@ -321,11 +527,16 @@ class CommandIdenticalTag : public Command {
 public:
 	CommandIdenticalTag(std::string key, std::string val) : mKeyCompare(key), mValCompare(val) {}
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
     return std::any_of(obj.tags().cbegin(), obj.tags().cend(), [this](const osmium::Tag& t) {
       return mKeyCompare.executeSingleTag(t) && mValCompare.executeSingleTag(t);
     });
   }
+  
+  osmium::io::TagCondition::node_id tagCondition(osmium::io::TagCondition& cond, bool& exact) {
+    exact = true;
+    return cond.tag(mKeyCompare.getKey(), mValCompare.getValue());
+  }
 
 private: 
 	CommandEqualKey mKeyCompare;
@@ -339,17 +550,28 @@ public:
 		mCommand = cmd;
 	}
   
-  bool execute(const osmium::OSMObject& obj) {
-    return !mCommand->execute(obj);
-  }
-  
-  void clear() {
-    mCommand->clear();
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
+    return !mCommand->execute(obj, state);
   }
   
   bool requiresAllEntities() {
     return mCommand->requiresAllEntities();
   }
+  
+  std::shared_ptr<Command> simplify() {
+    simplifyCommand(mCommand);
+    return nullptr;
+  }
+  
+  // Only an exact condition can be negated
+  osmium::io::TagCondition::node_id tagCondition(osmium::io::TagCondition& cond, bool& exact) {
+    osmium::io::TagCondition::node_id child = mCommand->tagCondition(cond, exact);
+    if(child < 0 || !exact) {
+      exact = false;
+      return -1;
+    }
+    return cond.negation(child);
+  }
 
 private:
 	std::shared_ptr<Command> mCommand;
@@ -363,18 +585,42 @@ public:
 		mSecond = second;	
 	}
 
- 	bool execute(const osmium::OSMObject& obj) {
-		return mFirst->execute(obj) && mSecond->execute(obj);
+ 	bool execute(const osmium::OSMObject& obj, FilterState& state) const {
+		return mFirst->execute(obj, state) && mSecond->execute(obj, state);
 	}
   
-  void clear() {
-    mFirst->clear();
-    mSecond->clear();
-  }
-  
   bool requiresAllEntities() {
     return mFirst->requiresAllEntities() || mSecond->requiresAllEntities();
   }
+  
+  std::shared_ptr<Command> simplify() {
+    simplifyCommand(mFirst);
+    simplifyCommand(mSecond);
+    return nullptr;
+  }
+  
+  osmium::osm_entity_bits::type entities() {
+    return mFirst->entities() & mSecond->entities();
+  }
+  
+  // Either condition alone is necessary as well
+  osmium::io::TagCondition::node_id tagCondition(osmium::io::TagCondition& cond, bool& exact) {
+    bool first_exact;
+    bool second_exact;
+    osmium::io::TagCondition::node_id first = mFirst->tagCondition(cond, first_exact);
+    osmium::io::TagCondition::node_id second = mSecond->tagCondition(cond, second_exact);
+    exact = first >= 0 && second >= 0 && first_exact && second_exact;
+    if(first < 0) {
+      return second;
+    } else if(second < 0) {
+      return first;
+    }
+    return cond.conjunction(first, second);
+  }
+  
+  bool exhausted(const osmium::OSMObject& obj) {
+    return mFirst->exhausted(obj) || mSecond->exhausted(obj);
+  }
 
 private:
 	std::shared_ptr<Command> mFirst;
@@ -389,18 +635,73 @@ public:
 		mSecond = second;	
 	}
   
-	bool execute(const osmium::OSMObject& obj) {
-		return mFirst->execute(obj) || mSecond->execute(obj);
+	bool execute(const osmium::OSMObject& obj, FilterState& state) const {
+		return mFirst->execute(obj, state) || mSecond->execute(obj, state);
 	}
   
-  void clear() {
-    mFirst->clear();
-    mSecond->clear();
-  }
-  
   bool requiresAllEntities() {
     return mFirst->requiresAllEntities() || mSecond->requiresAllEntities();
   }
+  
+  // Id comparisons within a chain of ORs are replaced by a single id set
+  std::shared_ptr<Command> simplify() {
+    // flatten iteratively, since long chains of ORs are nested deeply
+    std::vector<std::shared_ptr<Command>> leaves;
+    std::vector<std::shared_ptr<Command>> todo { mSecond, mFirst };
+    while(!todo.empty()) {
+      std::shared_ptr<Command> cmd = todo.back();
+      todo.pop_back();
+      CommandOr* cmd_or = dynamic_cast<CommandOr*>(cmd.get());
+      if(cmd_or != nullptr) {
+        todo.push_back(cmd_or->mSecond);
+        todo.push_back(cmd_or->mFirst);
+      } else {
+        leaves.push_back(cmd);
+      }
+    }
+    std::shared_ptr<CommandIdSet> ids = std::make_shared<CommandIdSet>();
+    std::vector<std::shared_ptr<Command>> remaining;
+    bool ids_added = false;
+    for(std::shared_ptr<Command>& leaf : leaves) {
+      if(leaf->collectIds(*ids)) {
+        // the id set takes the position of the first id comparison
+        if(!ids_added) {
+          remaining.push_back(ids);
+          ids_added = true;
+        }
+      } else {
+        simplifyCommand(leaf);
+        remaining.push_back(leaf);
+      }
+    }
+    ids->finalize();
+    std::shared_ptr<Command> ret = remaining.front();
+    for(size_t i = 1; i < remaining.size(); ++i) {
+      ret = std::make_shared<CommandOr>(ret, remaining[i]);
+    }
+    return ret;
+  }
+  
+  osmium::osm_entity_bits::type entities() {
+    return mFirst->entities() | mSecond->entities();
+  }
+  
+  osmium::io::TagCondition::node_id tagCondition(osmium::io::TagCondition& cond, bool& exact) {
+    bool first_exact;
+    bool second_exact;
+    osmium::io::TagCondition::node_id first = mFirst->tagCondition(cond, first_exact);
+    osmium::io::TagCondition::node_id second = mSecond->tagCondition(cond, second_exact);
+    if(first < 0 || second < 0) {
+      exact = false;
+      return -1;
+    }
+    exact = first_exact && second_exact;
+    return cond.disjunction(first, second);
+  }
+  
+  bool exhausted(const osmium::OSMObject& obj) {
+    return mFirst->exhausted(obj) && mSecond->exhausted(obj);
+  }
 
 private:
 	std::shared_ptr<Command> mFirst;
@@ -415,7 +716,7 @@ public:
     mSecond = second;
   } 
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
     std::shared_ptr<double> res1 = mFirst->execute(obj);
     std::shared_ptr<double> res2 = mSecond->execute(obj);
     if(res1 != nullptr && res2 != nullptr) {
@@ -437,7 +738,7 @@ public:
     mSecond = second;
   } 
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
     std::shared_ptr<double> res1 = mFirst->execute(obj);
     std::shared_ptr<double> res2 = mSecond->execute(obj);
     if(res1 != nullptr && res2 != nullptr) {
@@ -459,7 +760,7 @@ public:
     mSecond = second;
   } 
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
     std::shared_ptr<double> res1 = mFirst->execute(obj);
     std::shared_ptr<double> res2 = mSecond->execute(obj);
     if(res1 != nullptr && res2 != nullptr) {
@@ -481,7 +782,7 @@ public:
     mSecond = second;
   }
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
     std::shared_ptr<double> res1 = mFirst->execute(obj);
     std::shared_ptr<double> res2 = mSecond->execute(obj);
     if(res1 != nullptr && res2 != nullptr) {
@@ -503,7 +804,7 @@ public:
     mSecond = second;
   } 
   
-  bool execute(const osmium::OSMObject& obj) {
+  bool execute(const osmium::OSMObject& obj, FilterState& state) const {
     std::shared_ptr<double> res1 = mFirst->execute(obj);
     std::shared_ptr<double> res2 = mSecond->execute(obj);
     if(res1 != nullptr && res2 != nullptr) {
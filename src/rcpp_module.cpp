@@ -43,18 +43,39 @@
 
 #include "object_filter/interpreter.h"
 #include "OSMObjects.hpp"
+#include "BlockIndex.hpp"
+#include "LazyVectors.hpp"
+#include "FileStats.hpp"
+#include "AreaCollector.hpp"
+#include "MembershipIndex.hpp"
+#include "TagMatrix.hpp"
+#include "Profile.hpp"
+#include "DataGenerator.hpp"
+#include "GeoJSONExport.hpp"
+#include "ColumnFile.hpp"
 
 RCPP_EXPOSED_CLASS(OSMReader)
+RCPP_EXPOSED_CLASS(BlockIndex)
+RCPP_EXPOSED_CLASS(MembershipIndex)
 RCPP_EXPOSED_CLASS(CountHandler)
 RCPP_EXPOSED_CLASS(RHandler)
+RCPP_EXPOSED_CLASS(Cursor)
+RCPP_EXPOSED_CLASS(ObjectTable)
 RCPP_EXPOSED_CLASS(WriteHandler)
+RCPP_EXPOSED_CLASS(GeoJSONHandler)
+RCPP_EXPOSED_CLASS(ColumnFileHandler)
+RCPP_EXPOSED_CLASS(ColumnFile)
 RCPP_EXPOSED_CLASS(Dummy)
+RCPP_EXPOSED_CLASS(Generator)
 RCPP_EXPOSED_CLASS(ObjectFilter)
   
 typedef std::map<osmium::osm_entity_bits::type, Rcpp::Function> EntityFunctionMap;
 typedef std::pair<osmium::osm_entity_bits::type, Rcpp::Function> EntityFunctionPair;
 typedef osmium::index::map::SparseMemArray<osmium::unsigned_object_id_type, osmium::Location> sparse_mem_array;
+typedef osmium::index::map::DenseMemArray<osmium::unsigned_object_id_type, osmium::Location> dense_mem_array;
+typedef osmium::index::map::CompressedMemArray<osmium::unsigned_object_id_type, osmium::Location> compressed_mem_array;
 typedef osmium::index::map::Map<osmium::unsigned_object_id_type, osmium::Location> index_type;
+typedef osmium::handler::NodeLocationsForWays<index_type> location_handler_type;
 
 class ParseException : public std::exception
 {
@@ -72,6 +93,7 @@ public:
     try {
       if(!i.parse(expr)) {
         mCommand = i.returnAST();
+        tagfilter::simplifyCommand(mCommand);
       } else {
         throw ParseEx; 
       }
@@ -80,6 +102,43 @@ public:
     }
   } 
   
+  ObjectFilter(Rcpp::NumericVector ids, unsigned char object_type) {
+    std::shared_ptr<tagfilter::CommandIdSet> cmd = std::make_shared<tagfilter::CommandIdSet>();
+    osmium::item_type item_type;
+    switch(object_type) {
+    case osmium::osm_entity_bits::node:
+      item_type = osmium::item_type::node;
+      break;
+    case osmium::osm_entity_bits::way:
+      item_type = osmium::item_type::way;
+      break;
+    case osmium::osm_entity_bits::relation:
+      item_type = osmium::item_type::relation;
+      break;
+    default:
+      Rcpp::stop("id filters require exactly one of EntityBits.node, EntityBits.way or EntityBits.relation");
+    }
+    for(double id : ids) {
+      if(ISNAN(id) || id != std::floor(id)) {
+        Rcpp::stop("ids have to be integral numbers");
+      }
+      cmd->add(static_cast<osmium::object_id_type>(id), item_type);
+    }
+    cmd->finalize();
+    mCommand = cmd;
+  }
+  
+  ObjectFilter(ObjectFilter& first, ObjectFilter& second, std::string op) {
+    if(op == "and") {
+      mCommand = std::make_shared<tagfilter::CommandAnd>(first.getCommand(), second.getCommand());
+    } else if(op == "or") {
+      mCommand = std::make_shared<tagfilter::CommandOr>(first.getCommand(), second.getCommand());
+    } else {
+      Rcpp::stop("unknown operator '" + op + "' for combining filters");
+    }
+    tagfilter::simplifyCommand(mCommand);
+  }
+  
   std::shared_ptr<tagfilter::Command> getCommand() {
     return mCommand;
   }
@@ -110,11 +169,12 @@ class HandlerWithFilter : public osmium::handler::Handler {
 public:
   
   inline void registerObjectFilter(ObjectFilter& filter) {
-    mObjectFilter = filter.getCommand();
+    setObjectFilter(filter.getCommand());
   } 
   
   inline void setObjectFilter(std::shared_ptr<tagfilter::Command> filter) {
     mObjectFilter = filter;
+    mFilterState.clear();
   }
   
   inline std::shared_ptr<tagfilter::Command> getFilter() {
@@ -122,13 +182,22 @@ public:
   }
   
   inline bool meetsFilterCondition(const osmium::OSMObject& obj) {
-    return mObjectFilter == nullptr || mObjectFilter->execute(obj);
+    if(mObjectFilter == nullptr) {
+      return true;
+    }
+    osmium::util::ProfileTimer timer(mFilterStage);
+    return mObjectFilter->execute(obj, mFilterState);
   }  
   
+  // Has to be called before each run, the filter is only timed if profiling
+  // is enabled at that point
+  void resolveProfileStages() {
+    mFilterStage = osmium::util::Profile::instance().stage("filter");
+  }
+  
+  // The filter itself doesn't change, only the state of the handler's runs
   void clearFilter() {
-    if(mObjectFilter != nullptr) {
-      mObjectFilter->clear();
-    }
+    mFilterState.clear();
   } 
   
   bool requiresAllEntities() {
@@ -141,6 +210,8 @@ public:
   
 private:
    std::shared_ptr<tagfilter::Command> mObjectFilter = nullptr; 
+   tagfilter::FilterState mFilterState;
+   osmium::util::Profile::Stage* mFilterStage = nullptr;
 };
 
 class WriteHandler : public HandlerWithFilter {
@@ -218,6 +289,296 @@ private:
   }
 };
 
+// Exports the objects meeting the filter condition with their geometries
+// (points, linestrings and multipolygons) as newline delimited GeoJSON
+class GeoJSONHandler : public HandlerWithFilter {
+  
+public:
+  
+  GeoJSONHandler(std::string filename, Rcpp::CharacterVector keys, unsigned char geometries, bool overwrite) :
+    mFilename(filename), mKeys(keys.begin(), keys.end()), mOverwrite(overwrite) {
+    mGeometries = static_cast<osmium::osm_entity_bits::type>(geometries & osmium::osm_entity_bits::nwra);
+  }
+  
+  void init() {
+    mWriter.reset(new GeoJSONSeqWriter(mFilename, mKeys, mOverwrite));
+  }
+  
+  // Ways areas are assembled from are exported as areas only. Set by the
+  // reader while the areas are assembled.
+  void setAreaWays(areacollector::way_predicate_type area_ways) {
+    mAreaWays = area_ways;
+  }
+  
+  void close() {
+    clearFilter();
+    mAreaWays = nullptr;
+    mWriter->close();
+    mFeatures = mWriter->features();
+    mSkipped = mWriter->skipped();
+    mWriter = nullptr;
+  }
+  
+  // Closes the file after an error, ignoring further errors
+  void abort() {
+    clearFilter();
+    mAreaWays = nullptr;
+    mWriter = nullptr;
+  }
+  
+  bool exportsAreas() {
+    return mGeometries & osmium::osm_entity_bits::area;
+  }
+  
+  bool needsLocations() {
+    return mGeometries & (osmium::osm_entity_bits::way | osmium::osm_entity_bits::area);
+  }
+  
+  void node(const osmium::Node& node) {
+    if((mGeometries & osmium::osm_entity_bits::node) && meetsFilterCondition(node)) {
+      mWriter->node(node);
+    }
+  }
+  
+  void way(const osmium::Way& way) {
+    if((mGeometries & osmium::osm_entity_bits::way) && !(mAreaWays && mAreaWays(way)) && meetsFilterCondition(way)) {
+      mWriter->way(way);
+    }
+  }
+  
+  void area(const osmium::Area& area) {
+    if((mGeometries & osmium::osm_entity_bits::area) && meetsFilterCondition(area)) {
+      mWriter->area(area);
+    }
+  }
+  
+  double features() {
+    return static_cast<double>(mFeatures);
+  }
+  
+  double skipped() {
+    return static_cast<double>(mSkipped);
+  }
+  
+private:
+  std::string mFilename;
+  std::vector<std::string> mKeys;
+  bool mOverwrite;
+  osmium::osm_entity_bits::type mGeometries;
+  areacollector::way_predicate_type mAreaWays;
+  std::unique_ptr<GeoJSONSeqWriter> mWriter;
+  uint64_t mFeatures = 0;
+  uint64_t mSkipped = 0;
+};
+
+// Exports the objects meeting the filter condition as rows of a column file
+// with the given tag keys as columns
+class ColumnFileHandler : public HandlerWithFilter {
+  
+public:
+  
+  ColumnFileHandler(std::string filename, Rcpp::CharacterVector keys, unsigned char entities, bool with_geometry, bool overwrite) :
+    mFilename(filename), mKeys(keys.begin(), keys.end()), mWithGeometry(with_geometry), mOverwrite(overwrite) {
+    mEntities = static_cast<osmium::osm_entity_bits::type>(entities & osmium::osm_entity_bits::nwra);
+  }
+  
+  void init() {
+    mWriter.reset(new ColumnFileWriter(mFilename, mKeys, mWithGeometry, mOverwrite));
+  }
+  
+  void close() {
+    clearFilter();
+    mWriter->close();
+    mRows = mWriter->rows();
+    mWriter = nullptr;
+  }
+  
+  // Leaves an incomplete file after an error
+  void abort() {
+    clearFilter();
+    mWriter = nullptr;
+  }
+  
+  bool exportsAreas() {
+    return mEntities & osmium::osm_entity_bits::area;
+  }
+  
+  bool needsLocations() {
+    return exportsAreas() || (mWithGeometry && (mEntities & osmium::osm_entity_bits::way));
+  }
+  
+  void node(const osmium::Node& node) {
+    if((mEntities & osmium::osm_entity_bits::node) && meetsFilterCondition(node)) {
+      mWriter->add(node, 1, node.id(), node.location(), mWithGeometry && node.location().valid() ? mFactory.create_point(node) : std::string());
+    }
+  }
+  
+  void way(const osmium::Way& way) {
+    if((mEntities & osmium::osm_entity_bits::way) && meetsFilterCondition(way)) {
+      mWriter->add(way, 2, way.id(), osmium::Location(), mWithGeometry ? geometry(way) : std::string());
+    }
+  }
+  
+  void relation(const osmium::Relation& rel) {
+    if((mEntities & osmium::osm_entity_bits::relation) && meetsFilterCondition(rel)) {
+      mWriter->add(rel, 3, rel.id(), osmium::Location(), std::string());
+    }
+  }
+  
+  void area(const osmium::Area& area) {
+    if((mEntities & osmium::osm_entity_bits::area) && meetsFilterCondition(area)) {
+      mWriter->add(area, area.from_way() ? 4 : 5, area.orig_id(), osmium::Location(), mWithGeometry ? geometry(area) : std::string());
+    }
+  }
+  
+  double rows() {
+    return static_cast<double>(mRows);
+  }
+  
+private:
+  std::string mFilename;
+  std::vector<std::string> mKeys;
+  bool mWithGeometry;
+  bool mOverwrite;
+  osmium::osm_entity_bits::type mEntities;
+  std::unique_ptr<ColumnFileWriter> mWriter;
+  osmium::geom::WKBFactory<> mFactory;
+  uint64_t mRows = 0;
+  
+  // Empty if the geometry is invalid
+  std::string geometry(const osmium::Way& way) {
+    try {
+      return mFactory.create_linestring(way);
+    } catch(osmium::geometry_error&) {
+    } catch(osmium::invalid_location&) {
+    }
+    return std::string();
+  }
+  
+  std::string geometry(const osmium::Area& area) {
+    try {
+      return mFactory.create_multipolygon(area);
+    } catch(osmium::geometry_error&) {
+    } catch(osmium::invalid_location&) {
+    }
+    return std::string();
+  }
+};
+
+// Reads the columns of a column file into R vectors
+class ColumnFile {
+public:
+  
+  ColumnFile(std::string filename) : mFilename(filename) {
+    try {
+      mReader = std::make_shared<ColumnFileReader>(filename);
+    } catch(std::exception& e) {
+      Rcpp::stop(e.what());
+    }
+  }
+  
+  std::string getFilename() {
+    return mFilename;
+  }
+  
+  double rows() {
+    return static_cast<double>(mReader->rows());
+  }
+  
+  Rcpp::CharacterVector columns() {
+    Rcpp::CharacterVector ret;
+    for(const columnfile::Column& column : mReader->columns()) {
+      ret.push_back(column.name);
+    }
+    return ret;
+  }
+  
+  // Data frame with the given columns, strings are returned as factors or
+  // character vectors, geometries as lists of raw vectors (NULL if missing)
+  Rcpp::List read(Rcpp::CharacterVector names, bool strings_as_factors) {
+    Rcpp::List ret(names.size());
+    for(int i = 0; i < names.size(); ++i) {
+      const int column = mReader->find(Rcpp::as<std::string>(names[i]));
+      if(column < 0) {
+        Rcpp::stop("column '" + Rcpp::as<std::string>(names[i]) + "' does not exist");
+      }
+      ret[i] = readColumn(column, strings_as_factors);
+    }
+    ret.attr("names") = names;
+    ret.attr("row.names") = Rcpp::IntegerVector::create(NA_INTEGER, -static_cast<int>(mReader->rows()));
+    ret.attr("class") = "data.frame";
+    return ret;
+  }
+  
+private:
+  std::string mFilename;
+  std::shared_ptr<ColumnFileReader> mReader;
+  
+  SEXP readColumn(size_t column, bool strings_as_factors) {
+    const columnfile::Column& col = mReader->columns()[column];
+    const std::vector<columnfile::Chunk>& chunks = mReader->chunks();
+    const R_xlen_t n = static_cast<R_xlen_t>(mReader->rows());
+    R_xlen_t row = 0;
+    switch(col.type) {
+    case columnfile::col_int64: {
+      Rcpp::NumericVector ret(n);
+      for(size_t c = 0; c < chunks.size(); ++c) {
+        const int64_t* values = reinterpret_cast<const int64_t*>(mReader->data(c, column));
+        for(uint64_t r = 0; r < chunks[c].rows; ++r) {
+          ret[row++] = static_cast<double>(values[r]);
+        }
+      }
+      return ret;
+    }
+    case columnfile::col_double: {
+      Rcpp::NumericVector ret(n);
+      for(size_t c = 0; c < chunks.size(); ++c) {
+        std::memcpy(ret.begin() + row, mReader->data(c, column), chunks[c].rows * sizeof(double));
+        row += chunks[c].rows;
+      }
+      return ret;
+    }
+    case columnfile::col_dict: {
+      // the reader has checked that the codes are NA or valid levels
+      Rcpp::IntegerVector codes(n);
+      for(size_t c = 0; c < chunks.size(); ++c) {
+        std::memcpy(codes.begin() + row, mReader->data(c, column), chunks[c].rows * sizeof(int32_t));
+        row += chunks[c].rows;
+      }
+      Rcpp::CharacterVector levels(col.levels.size());
+      for(size_t l = 0; l < col.levels.size(); ++l) {
+        levels[l] = Rf_mkCharLenCE(col.levels[l].data(), col.levels[l].size(), CE_UTF8);
+      }
+      if(strings_as_factors) {
+        codes.attr("levels") = levels;
+        codes.attr("class") = "factor";
+        return codes;
+      }
+      Rcpp::CharacterVector ret(n);
+      const int* code = codes.begin();
+      for(R_xlen_t r = 0; r < n; ++r) {
+        SET_STRING_ELT(ret, r, code[r] == NA_INTEGER ? NA_STRING : STRING_ELT(levels, code[r] - 1));
+      }
+      return ret;
+    }
+    case columnfile::col_blob: {
+      Rcpp::List ret(n);
+      for(size_t c = 0; c < chunks.size(); ++c) {
+        const uint64_t* offsets = reinterpret_cast<const uint64_t*>(mReader->data(c, column));
+        const Rbyte* bytes = reinterpret_cast<const Rbyte*>(offsets + chunks[c].rows + 1);
+        for(uint64_t r = 0; r < chunks[c].rows; ++r, ++row) {
+          if(offsets[r + 1] > offsets[r]) {
+            ret[row] = Rcpp::RawVector(bytes + offsets[r], bytes + offsets[r + 1]);
+          }
+        }
+      }
+      return ret;
+    }
+    }
+    return R_NilValue;
+  }
+};
+
 class WriteHelper : public HandlerWithFilter {
 public:
   
@@ -273,6 +634,168 @@ private:
   WriteHandler& mWriter; 
 }; 
 
+// Keeps the matching objects in memory and returns them as columns which are
+// decoded lazily on access
+class ObjectTable : public HandlerWithFilter {
+public:
+  
+  ObjectTable() {
+    mStore = std::make_shared<ObjectStore>();
+  }
+  
+  // Columns created before keep the objects of the previous run
+  void init() {
+    mStore = std::make_shared<ObjectStore>();
+  }
+  
+  void node(const osmium::Node& node) {
+    if(meetsFilterCondition(node)) {
+      mStore->add(node);
+    }
+  }
+  
+  void way(const osmium::Way& way) {
+    if(meetsFilterCondition(way)) {
+      mStore->add(way);
+    }
+  }
+  
+  void relation(const osmium::Relation& rel) {
+    if(meetsFilterCondition(rel)) {
+      mStore->add(rel);
+    }
+  }
+  
+  int size() {
+    return mStore->size();
+  }
+  
+  SEXP tag(std::string key) {
+    return makeLazyColumn(mStore, field_tag, key);
+  }
+  
+  Rcpp::List columns(Rcpp::CharacterVector tags) {
+    Rcpp::List ret(4 + tags.size());
+    Rcpp::CharacterVector names(ret.size());
+    ret[0] = makeLazyColumn(mStore, field_type);
+    names[0] = "type";
+    ret[1] = makeLazyColumn(mStore, field_id);
+    names[1] = "id";
+    ret[2] = makeLazyColumn(mStore, field_lon);
+    names[2] = "lon";
+    ret[3] = makeLazyColumn(mStore, field_lat);
+    names[3] = "lat";
+    for(int i = 0; i < tags.size(); ++i) {
+      ret[4 + i] = makeLazyColumn(mStore, field_tag, Rcpp::as<std::string>(tags[i]));
+      names[4 + i] = tags[i];
+    }
+    ret.attr("names") = names;
+    ret.attr("row.names") = Rcpp::IntegerVector::create(NA_INTEGER, -size());
+    ret.attr("class") = "data.frame";
+    return ret;
+  }
+  
+private:
+  std::shared_ptr<ObjectStore> mStore;
+};
+
+// Sparse matrix with one row per matching object and one column per feature
+// (tag key or tag). Without features the vocabulary is learned from the
+// objects in a first pass.
+class TagMatrix : public HandlerWithFilter {
+public:
+  
+  TagMatrix(Rcpp::CharacterVector features, bool with_values, double min_count) : mBuilder(with_values) {
+    mMinCount = min_count;
+    mLearnVocabulary = features.size() == 0;
+    if(!mLearnVocabulary) {
+      mBuilder.setVocabulary(Rcpp::as<std::vector<std::string>>(features));
+    }
+  }
+  
+  void node(const osmium::Node& node) {
+    if(meetsFilterCondition(node)) {
+      mBuilder.add(node);
+    }
+  }
+  
+  void way(const osmium::Way& way) {
+    if(meetsFilterCondition(way)) {
+      mBuilder.add(way);
+    }
+  }
+  
+  void relation(const osmium::Relation& rel) {
+    if(meetsFilterCondition(rel)) {
+      mBuilder.add(rel);
+    }
+  }
+  
+  bool learnsVocabulary() {
+    return mLearnVocabulary;
+  }
+  
+  void startCounting() {
+    mBuilder.startCounting();
+  }
+  
+  void learnVocabulary() {
+    mBuilder.learnVocabulary(static_cast<uint64_t>(std::max(mMinCount, 1.0)));
+  }
+  
+  void init() {
+    mBuilder.clearRows();
+  }
+  
+  void finish() {
+    mBuilder.flush();
+  }
+  
+  // Components of the matrix (0-based like in Matrix::dgCMatrix) and the
+  // type, id and location of the object of every row
+  Rcpp::List result() {
+    const std::vector<std::string>& features = mBuilder.features();
+    if(mBuilder.nonZeros() > static_cast<size_t>(std::numeric_limits<int>::max())) {
+      Rcpp::stop("the tag matrix has too many non-zero elements");
+    }
+    Rcpp::IntegerVector p(features.size() + 1);
+    Rcpp::IntegerVector i(mBuilder.nonZeros());
+    mBuilder.columnForm(p, i);
+    Rcpp::NumericVector x(mBuilder.nonZeros(), 1.0);
+    
+    const size_t n = mBuilder.rows();
+    Rcpp::CharacterVector type(n);
+    Rcpp::NumericVector id(n);
+    Rcpp::NumericVector lon(n);
+    Rcpp::NumericVector lat(n);
+    for(size_t k = 0; k < n; ++k) {
+      type[k] = osmium::item_type_to_name(mBuilder.types()[k]);
+      id[k] = static_cast<double>(mBuilder.ids()[k]);
+      const osmium::Location& loc = mBuilder.locations()[k];
+      lon[k] = loc.valid() ? loc.lon_without_check() : NA_REAL;
+      lat[k] = loc.valid() ? loc.lat_without_check() : NA_REAL;
+    }
+    Rcpp::CharacterVector feature_names(features.size());
+    for(size_t j = 0; j < features.size(); ++j) {
+      feature_names[j] = Rf_mkCharCE(features[j].c_str(), CE_UTF8);
+    }
+    return Rcpp::List::create(Rcpp::Named("i") = i,
+                              Rcpp::Named("p") = p,
+                              Rcpp::Named("x") = x,
+                              Rcpp::Named("dim") = Rcpp::IntegerVector::create(static_cast<int>(n), static_cast<int>(features.size())),
+                              Rcpp::Named("features") = feature_names,
+                              Rcpp::Named("type") = type,
+                              Rcpp::Named("id") = id,
+                              Rcpp::Named("lon") = lon,
+                              Rcpp::Named("lat") = lat);
+  }
+  
+private:
+  TagMatrixBuilder mBuilder;
+  double mMinCount;
+  bool mLearnVocabulary;
+};
+
 class RHandler : public osmium::handler::Handler {
 public: 
   
@@ -299,28 +822,46 @@ public:
   
   void registerObjectFilter(ObjectFilter& filter) {
     mObjectFilter = filter.getCommand();
+    mFilterState.clear();
+  }
+  
+  void setTagKeys(Rcpp::CharacterVector keys) {
+    mRWrapper.setTagKeys(Rcpp::as<std::vector<std::string>>(keys));
+  }
+  
+  // The keys of the tags which have to be decoded, nullptr if all tags are
+  // needed. The filter and the area assembly may need any tag.
+  osmium::io::tag_keys_type decodedTagKeys() {
+    if(mObjectFilter != nullptr || hasAreaCallback()) {
+      return nullptr;
+    }
+    return mRWrapper.neededTagKeys();
   }
   
   void node(const osmium::Node& node) {
     if(mFunctions.count(osmium::osm_entity_bits::node) && meetsFilterCondition(node) && mCurrentCount++ < mResultSize) {     
+      osmium::util::ProfileTimer timer(mCallbackStage);
       (mFunctions.at(osmium::osm_entity_bits::node))(mRWrapper.createRNode(node), mCurrentCount);
     }
   }
   
   void way(const osmium::Way& way) {
     if(mFunctions.count(osmium::osm_entity_bits::way) && meetsFilterCondition(way) && mCurrentCount++ < mResultSize) {
+        osmium::util::ProfileTimer timer(mCallbackStage);
         (mFunctions.at(osmium::osm_entity_bits::way))(mRWrapper.createRWay(way), mCurrentCount);
     }
   }
 
   void relation(const osmium::Relation& rel) {
     if(mFunctions.count(osmium::osm_entity_bits::relation) && meetsFilterCondition(rel) && mCurrentCount++ < mResultSize) {
+      osmium::util::ProfileTimer timer(mCallbackStage);
       (mFunctions.at(osmium::osm_entity_bits::relation))(mRWrapper.createRRelation(rel), mCurrentCount);
     }
   }
   
   void area(const osmium::Area& area) {
     if(mFunctions.count(osmium::osm_entity_bits::area) && meetsFilterCondition(area) && mCurrentCount++ < mResultSize) {
+      osmium::util::ProfileTimer timer(mCallbackStage);
       (mFunctions.at(osmium::osm_entity_bits::area))(mRWrapper.createRArea(area), mCurrentCount);
     }   
   }
@@ -329,6 +870,20 @@ public:
     return mFunctions.count(osmium::osm_entity_bits::area) > 0;
   }
   
+  std::shared_ptr<tagfilter::Command> getFilter() {
+    return mObjectFilter;
+  }
+  
+  void clearFilter() {
+    mFilterState.clear();
+  }
+  
+  // Has to be called before each run, see HandlerWithFilter
+  void resolveProfileStages() {
+    mFilterStage = osmium::util::Profile::instance().stage("filter");
+    mCallbackStage = osmium::util::Profile::instance().stage("r_callback");
+  }
+  
 private:
   
   void setFunction(Rcpp::Function& func, osmium::osm_entity_bits::type object_type) {
@@ -340,16 +895,131 @@ private:
   }
   
   inline bool meetsFilterCondition(const osmium::OSMObject& obj) {
-    return mObjectFilter == nullptr || mObjectFilter->execute(obj);
+    if(mObjectFilter == nullptr) {
+      return true;
+    }
+    osmium::util::ProfileTimer timer(mFilterStage);
+    return mObjectFilter->execute(obj, mFilterState);
   } 
   
   int mCurrentCount = 0;
   RosmiumWrapper mRWrapper;
   EntityFunctionMap mFunctions;
   std::shared_ptr<tagfilter::Command> mObjectFilter = nullptr;
+  tagfilter::FilterState mFilterState;
+  osmium::util::Profile::Stage* mFilterStage = nullptr;
+  osmium::util::Profile::Stage* mCallbackStage = nullptr;
 };
 
 
+// Pull based access to the objects of a file: each call of fetch() converts
+// the next objects only, so arbitrarily large files can be read in chunks.
+class Cursor {
+public:
+  
+  Cursor(std::string filename, unsigned char read_which_entities, Rcpp::CharacterVector object_includes, bool with_locations) : mRWrapper(object_includes) {
+    mReader = std::unique_ptr<osmium::io::Reader>(new osmium::io::Reader(filename, (osmium::osm_entity_bits::type) read_which_entities));
+    if(with_locations) {
+      mIndex = std::unique_ptr<index_type>(new sparse_mem_array());
+      mLocationHandler = std::unique_ptr<location_handler_type>(new location_handler_type(*mIndex));
+      mLocationHandler->ignore_errors();
+    }
+  }
+  
+  void registerObjectFilter(ObjectFilter& filter) {
+    mObjectFilter = filter.getCommand();
+    mFilterState.clear();
+  }
+  
+  void setTagKeys(Rcpp::CharacterVector keys) {
+    mRWrapper.setTagKeys(Rcpp::as<std::vector<std::string>>(keys));
+  }
+  
+  Rcpp::List fetch(int n) {
+    // NA arrives as INT_MIN
+    if(n < 0) {
+      Rcpp::stop("n has to be a non-negative number");
+    }
+    Rcpp::List ret(n);
+    int count = 0;
+    while(count < n && nextObject()) {
+      osmium::OSMObject& obj = *mIterator;
+      ++mIterator;
+      if(mLocationHandler != nullptr) {
+        osmium::apply_item(obj, *mLocationHandler);
+      }
+      if(mObjectFilter != nullptr && !mObjectFilter->execute(obj, mFilterState)) {
+        continue;
+      }
+      switch(obj.type()) {
+      case osmium::item_type::node:
+        ret[count++] = mRWrapper.createRNode(static_cast<const osmium::Node&>(obj));
+        break;
+      case osmium::item_type::way:
+        ret[count++] = mRWrapper.createRWay(static_cast<const osmium::Way&>(obj));
+        break;
+      case osmium::item_type::relation:
+        ret[count++] = mRWrapper.createRRelation(static_cast<const osmium::Relation&>(obj));
+        break;
+      default:
+        break;
+      }
+    }
+    if(count == n) {
+      return ret;
+    }
+    Rcpp::List shortened(count);
+    for(int i = 0; i < count; ++i) {
+      shortened[i] = ret[i];
+    }
+    return shortened;
+  }
+  
+  bool isDone() {
+    return mDone;
+  }
+  
+  void close() {
+    if(!mDone) {
+      mDone = true;
+      mReader->close();
+    }
+    mBuffer = osmium::memory::Buffer();
+    mLocationHandler = nullptr;
+    mIndex = nullptr;
+  }
+  
+private:
+  
+  typedef osmium::memory::Buffer::t_iterator<osmium::OSMObject> object_iterator;
+  
+  // Moves to the next buffer if necessary. Returns false at the end of the file.
+  bool nextObject() {
+    while(!mBuffer || mIterator == mBuffer.end<osmium::OSMObject>()) {
+      if(mDone) {
+        return false;
+      }
+      mBuffer = mReader->read();
+      if(!mBuffer) {
+        close();
+        return false;
+      }
+      mIterator = mBuffer.begin<osmium::OSMObject>();
+    }
+    return true;
+  }
+  
+  std::unique_ptr<osmium::io::Reader> mReader;
+  std::unique_ptr<index_type> mIndex;
+  std::unique_ptr<location_handler_type> mLocationHandler;
+  osmium::memory::Buffer mBuffer;
+  object_iterator mIterator;
+  bool mDone = false;
+  RosmiumWrapper mRWrapper;
+  std::shared_ptr<tagfilter::Command> mObjectFilter = nullptr;
+  tagfilter::FilterState mFilterState;
+};
+
 
 
 void set_lon(osmium::Location* loc, double lon) {
@@ -360,31 +1030,176 @@ void set_lat(osmium::Location* loc, double lat) {
  loc->set_lat(lat);
 }
 
+osmium::item_type membershipItemType(unsigned char entity_type) {
+  switch(entity_type) {
+  case osmium::osm_entity_bits::node:
+    return osmium::item_type::node;
+  case osmium::osm_entity_bits::way:
+    return osmium::item_type::way;
+  case osmium::osm_entity_bits::relation:
+    return osmium::item_type::relation;
+  default:
+    Rcpp::stop("memberships can only be queried for exactly one of EntityBits.node, EntityBits.way or EntityBits.relation");
+  }
+}
+
+// Data frame with the ids of the objects and the ids of the parent objects
+// containing them (one row per membership)
+Rcpp::DataFrame membership_parents(MembershipIndex* index, Rcpp::NumericVector ids, unsigned char entity_type, unsigned char parent_type) {
+  membershipindex::Table table;
+  try {
+    table = MembershipIndex::table(membershipItemType(entity_type), membershipItemType(parent_type));
+  } catch(std::invalid_argument& e) {
+    Rcpp::stop(e.what());
+  }
+  std::vector<osmium::unsigned_object_id_type> id_vec;
+  id_vec.reserve(ids.size());
+  for(double id : ids) {
+    id_vec.push_back(static_cast<osmium::unsigned_object_id_type>(std::abs(id)));
+  }
+  std::vector<MembershipIndex::entry_type> entries = index->parents(std::move(id_vec), table);
+  Rcpp::NumericVector id_col(entries.size());
+  Rcpp::NumericVector parent_col(entries.size());
+  for(size_t i = 0; i < entries.size(); ++i) {
+    id_col[i] = static_cast<double>(entries[i].first);
+    parent_col[i] = static_cast<double>(entries[i].second);
+  }
+  return Rcpp::DataFrame::create(Rcpp::Named("id") = id_col, Rcpp::Named("parent") = parent_col);
+}
+
 class OSMReader {
   
 private:
   std::string mFilename;
   osmium::osm_entity_bits::type mEntities;
+  std::shared_ptr<BlockIndex> mIndex = nullptr;
+  BlockSelection mSelection;
+  bool mSpillAreaMembers = false;
+  std::string mAreaMode = "both";
+  osmium::relations::CollectorMemoryUsage mAreaMemory;
+  bool mProfiling = false;
+  profile::Report mProfile;
  
-// TODO: create index from string 
+  // Location index by name. The dense index needs 8 bytes per node id up to
+  // the largest id, so it only pays off for (nearly) complete id ranges. The
+  // compressed index trades lookup speed for a fraction of the sparse memory.
   std::unique_ptr<index_type> createIndex(const std::string& idx) {
-    if(idx == "sparse_mem_array") return std::unique_ptr<index_type>(new sparse_mem_array());
+    if(idx == "sparse_mem_array") {
+      return std::unique_ptr<index_type>(new sparse_mem_array());
+    } else if(idx == "dense_mem_array") {
+      return std::unique_ptr<index_type>(new dense_mem_array());
+    } else if(idx == "compressed_mem_array") {
+      return std::unique_ptr<index_type>(new compressed_mem_array());
+    }
+    Rcpp::stop("unknown location index '" + idx + "'");
+  }
+  
+  // Whether the file header states that objects are sorted by type and id
+  bool isSortedInput() {
+    osmium::io::Reader reader(mFilename, osmium::osm_entity_bits::nothing);
+    osmium::io::Header header = reader.header();
+    reader.close();
+    for(int i = 0; ; ++i) {
+      std::string feature = header.get("pbf_optional_feature_" + std::to_string(i));
+      if(feature.empty()) {
+        return false;
+      } else if(feature == "Sort.Type_then_ID") {
+        return true;
+      }
+    }
+  }
+  
+  // Applies the handler buffer by buffer. For sorted input, reading stops as
+  // soon as the filter can't be fulfilled by any further object.
+  template <typename THandler, typename TSource>
+  void apply_filtered(THandler& handler, TSource& source) {
+    std::shared_ptr<tagfilter::Command> filter = handler.getFilter();
+    bool sorted = filter != nullptr && isSortedInput();
+    while(osmium::memory::Buffer buffer = source.read()) {
+      auto first = buffer.begin<osmium::OSMObject>();
+      if(sorted && first != buffer.end<osmium::OSMObject>() && filter->exhausted(*first)) {
+        break;
+      }
+      osmium::apply(buffer, handler);
+    }
+  }
+  
+  // Entity types which have to be read in order to fulfill the filter
+  osmium::osm_entity_bits::type filterEntities(std::shared_ptr<tagfilter::Command> filter) {
+    if(filter == nullptr || filter->requiresAllEntities()) {
+      return mEntities;
+    }
+    return mEntities & filter->entities();
+  }
+  
+  bool isPBF() {
+    return osmium::io::File(mFilename).format() == osmium::io::file_format::pbf;
+  }
+  
+  // Reader decoding only the blobs of the block index matching the selection
+  IndexedReader createIndexedReader(osmium::osm_entity_bits::type entities, bool all_nodes,
+                                    const osmium::io::detail::decode_options& options = osmium::io::detail::decode_options()) {
+    return IndexedReader(mFilename, mIndex->select(mSelection, entities, all_nodes), entities, options);
+  }
+  
+  // The file with the tag keys needed and the filter pushed down into the
+  // decoder: a condition on the tags derived from the filter is checked
+  // before the objects are built, the filter itself on the built objects in
+  // the decoding threads. Only filters without state (no bounding box) are
+  // pushed down. The nodes are kept if their locations are needed.
+  osmium::io::File inputFile(std::shared_ptr<tagfilter::Command> filter, bool with_locations, osmium::io::tag_keys_type tag_keys) {
+    osmium::io::File file(mFilename);
+    file.set_tag_keys(tag_keys);
+    if(filter != nullptr && !filter->requiresAllEntities()) {
+      file.set_object_predicate([filter, with_locations](const osmium::OSMObject& obj) {
+        // the filter has no state, every thread can use its own empty one
+        tagfilter::FilterState state;
+        return (with_locations && obj.type() == osmium::item_type::node) || filter->execute(obj, state);
+      });
+      std::shared_ptr<osmium::io::TagCondition> condition = std::make_shared<osmium::io::TagCondition>();
+      bool exact;
+      osmium::io::TagCondition::node_id root = filter->tagCondition(*condition, exact);
+      if(root >= 0) {
+        condition->set_root(root);
+        condition->set_entities(with_locations ? osmium::osm_entity_bits::way | osmium::osm_entity_bits::relation : osmium::osm_entity_bits::nwr);
+        file.set_tag_condition(condition);
+      }
+    }
+    return file;
   }
  
-  void apply_with_location(RHandler& handler, osmium::io::Reader &r, const std::string &idx) {
-    std::unique_ptr<index_type> index = std::unique_ptr<index_type>(new sparse_mem_array());
+  // Applies the handler to the objects of the selection (or the whole file)
+  template <typename THandler>
+  void apply_selected(THandler& handler, osmium::osm_entity_bits::type entities) {
+    if(mIndex != nullptr) {
+      IndexedReader reader = createIndexedReader(entities, false);
+      osmium::apply(reader, handler);
+      reader.close();
+    } else {
+      osmium::io::Reader reader(mFilename, entities);
+      osmium::apply(reader, handler);
+      reader.close();
+    }
+  }
+  
+  template <typename THandler, typename TSource, typename... THandlers>
+  void apply_with_location(THandler& handler, TSource &r, const std::string &idx, THandlers&... more) {
+    std::unique_ptr<index_type> index = createIndex(idx);
     osmium::handler::NodeLocationsForWays<index_type> location_handler(*index);
     location_handler.ignore_errors();
-    osmium::apply(r, location_handler, handler);
+    ProfiledHandler<location_handler_type> profiled_location_handler(location_handler, "location_index");
+    osmium::apply(r, profiled_location_handler, handler, more...);
   }
    
-  void apply_with_area(RHandler& handler, osmium::io::Reader &r,
-                       osmium::area::MultipolygonCollector<osmium::area::Assembler> &collector,
+  template <typename THandler>
+  void apply_with_area(THandler& handler, osmium::io::Reader &r,
+                       ParallelMultipolygonCollector<osmium::area::Assembler> &collector,
                        const std::string &idx) {
-    std::unique_ptr<index_type> index = std::unique_ptr<index_type>(new sparse_mem_array());
+    std::unique_ptr<index_type> index = createIndex(idx);
     osmium::handler::NodeLocationsForWays<index_type> location_handler(*index);
     location_handler.ignore_errors();
-    osmium::apply(r, location_handler, handler,
+    ProfiledHandler<location_handler_type> profiled_location_handler(location_handler, "location_index");
+    osmium::apply(r, profiled_location_handler, handler,
                   collector.handler([&handler](const osmium::memory::Buffer& area_buffer) {
                     osmium::apply(area_buffer, handler);
                   }));
@@ -400,38 +1215,342 @@ public:
     return mFilename;
   }
   
+  unsigned char getEntities() {
+    return mEntities;
+  }
+  
+  bool getSpillAreaMembers() {
+    return mSpillAreaMembers;
+  }
+  
+  // Keeps the member ways of multipolygon relations in a temporary file
+  // instead of main memory while assembling areas
+  void setSpillAreaMembers(bool spill) {
+    mSpillAreaMembers = spill;
+  }
+  
+  std::string getAreaMode() {
+    return mAreaMode;
+  }
+  
+  // Objects areas are assembled from: "ways" (closed ways only, without the
+  // pass over the relations), "relations" (multipolygons only) or "both"
+  void setAreaMode(std::string mode) {
+    if(mode != "ways" && mode != "relations" && mode != "both") {
+      Rcpp::stop("area mode has to be one of 'ways', 'relations' or 'both'");
+    }
+    mAreaMode = mode;
+  }
+  
+  bool getProfiling() {
+    return mProfiling;
+  }
+  
+  // Records the time per stage of the following runs of applyR() and
+  // apply_writer()
+  void setProfiling(bool profiling) {
+    mProfiling = profiling;
+  }
+  
+  // Profile of the last profiled run
+  Rcpp::List profile() {
+    const std::vector<profile::StageRow>& stages = mProfile.stages;
+    Rcpp::CharacterVector stage_names(stages.size());
+    Rcpp::NumericVector seconds(stages.size()), calls(stages.size()), items(stages.size()), bytes(stages.size());
+    for(size_t i = 0; i < stages.size(); ++i) {
+      stage_names[i] = stages[i].name;
+      seconds[i] = stages[i].seconds;
+      calls[i] = static_cast<double>(stages[i].calls);
+      items[i] = static_cast<double>(stages[i].items);
+      bytes[i] = static_cast<double>(stages[i].bytes);
+    }
+    const std::vector<profile::QueueRow>& queues = mProfile.queues;
+    Rcpp::CharacterVector queue_names(queues.size());
+    Rcpp::NumericVector count(queues.size()), max_size(queues.size()), pushes(queues.size()), full(queues.size()),
+                        largest_size(queues.size()), mean_size(queues.size()), blocked_seconds(queues.size());
+    for(size_t i = 0; i < queues.size(); ++i) {
+      const osmium::util::Profile::QueueStats& stats = queues[i].stats;
+      queue_names[i] = queues[i].name;
+      count[i] = static_cast<double>(stats.queues);
+      max_size[i] = static_cast<double>(stats.max_size);
+      pushes[i] = static_cast<double>(stats.pushes);
+      full[i] = static_cast<double>(stats.full);
+      largest_size[i] = static_cast<double>(stats.largest_size);
+      mean_size[i] = stats.mean_size();
+      blocked_seconds[i] = stats.blocked_seconds;
+    }
+    return Rcpp::List::create(
+      Rcpp::Named("stages") = Rcpp::DataFrame::create(Rcpp::Named("stage") = stage_names,
+                                                      Rcpp::Named("seconds") = seconds,
+                                                      Rcpp::Named("calls") = calls,
+                                                      Rcpp::Named("items") = items,
+                                                      Rcpp::Named("bytes") = bytes,
+                                                      Rcpp::Named("stringsAsFactors") = false),
+      Rcpp::Named("queues") = Rcpp::DataFrame::create(Rcpp::Named("queue") = queue_names,
+                                                      Rcpp::Named("count") = count,
+                                                      Rcpp::Named("max_size") = max_size,
+                                                      Rcpp::Named("pushes") = pushes,
+                                                      Rcpp::Named("full") = full,
+                                                      Rcpp::Named("largest_size") = largest_size,
+                                                      Rcpp::Named("mean_size") = mean_size,
+                                                      Rcpp::Named("blocked_seconds") = blocked_seconds,
+                                                      Rcpp::Named("stringsAsFactors") = false));
+  }
+  
+  // Memory (in bytes) used by the relation collector of the last area run
+  Rcpp::NumericVector areaMemoryUsage() {
+    Rcpp::NumericVector ret = Rcpp::NumericVector::create(
+      Rcpp::Named("relations") = static_cast<double>(mAreaMemory.relations),
+      Rcpp::Named("members") = static_cast<double>(mAreaMemory.members),
+      Rcpp::Named("relations_buffer") = static_cast<double>(mAreaMemory.relations_buffer),
+      Rcpp::Named("members_buffer") = static_cast<double>(mAreaMemory.members_buffer),
+      Rcpp::Named("members_file") = static_cast<double>(mAreaMemory.members_file),
+      Rcpp::Named("total") = static_cast<double>(mAreaMemory.total()));
+    return ret;
+  }
+  
+  void use_index(BlockIndex& index) {
+    if(index.getFilename() != mFilename) {
+      Rcpp::stop("block index was built for file '" + index.getFilename() + "'");
+    }
+    mIndex = std::make_shared<BlockIndex>(index);
+  }
+  
+  void select_bounding_box(double min_lon, double min_lat, double max_lon, double max_lat) {
+    mSelection.box = osmium::Box(min_lon, min_lat, max_lon, max_lat);
+  }
+  
+  void select_ids(Rcpp::NumericVector ids, unsigned char object_type) {
+    std::vector<osmium::object_id_type> id_vec(ids.begin(), ids.end());
+    switch(object_type) {
+    case osmium::osm_entity_bits::node:
+      mSelection.addIds(id_vec, osmium::item_type::node);
+      break;
+    case osmium::osm_entity_bits::way:
+      mSelection.addIds(id_vec, osmium::item_type::way);
+      break;
+    case osmium::osm_entity_bits::relation:
+      mSelection.addIds(id_vec, osmium::item_type::relation);
+      break;
+    default:
+      Rcpp::stop("ids can only be selected for exactly one of EntityBits.node, EntityBits.way or EntityBits.relation");
+    }
+  }
+  
+  void clear_selection() {
+    mSelection.clear();
+  }
+  
   void apply(CountHandler& handler) {
+    if(mIndex != nullptr) {
+      IndexedReader reader = createIndexedReader(mEntities, false);
+      osmium::apply(reader, handler);
+      reader.close();
+      return;
+    }
+    if(isPBF()) {
+      FileStats stats = countPBF(mFilename, mEntities);
+      handler.nodes += stats.count[slot_node];
+      handler.ways += stats.count[slot_way];
+      handler.relations += stats.count[slot_relation];
+      return;
+    }
     osmium::io::Reader reader(mFilename, mEntities);
     osmium::apply(reader, handler);
     reader.close();
   }
   
-  void apply_r(RHandler& handler, bool with_locations = false, std::string idx = "sparse_mem_array") {
-    if(handler.hasAreaCallback()) {
+  Rcpp::List stats(bool with_keys, bool fast) {
+    FileStats stats = fast && isPBF() ? countPBF(mFilename, mEntities) : computeFileStats(mFilename, mEntities, with_keys);
+    Rcpp::CharacterVector type_names = Rcpp::CharacterVector::create("nodes", "ways", "relations");
+    Rcpp::NumericVector counts(3);
+    Rcpp::NumericVector min_ids(3);
+    Rcpp::NumericVector max_ids(3);
+    for(int slot = slot_node; slot <= slot_relation; ++slot) {
+      counts[slot] = static_cast<double>(stats.count[slot]);
+      min_ids[slot] = stats.count[slot] > 0 ? static_cast<double>(stats.minId[slot]) : NA_REAL;
+      max_ids[slot] = stats.count[slot] > 0 ? static_cast<double>(stats.maxId[slot]) : NA_REAL;
+    }
+    counts.names() = type_names;
+    min_ids.names() = type_names;
+    max_ids.names() = type_names;
+    
+    Rcpp::NumericVector timestamps = Rcpp::NumericVector::create(NA_REAL, NA_REAL);
+    if(stats.firstTimestamp <= stats.lastTimestamp) {
+      timestamps[0] = static_cast<double>(uint32_t(stats.firstTimestamp));
+      timestamps[1] = static_cast<double>(uint32_t(stats.lastTimestamp));
+    }
+    timestamps.attr("class") = Rcpp::CharacterVector::create("POSIXct", "POSIXt");
+    timestamps.attr("tzone") = "UTC";
+    
+    Rcpp::NumericVector bbox = Rcpp::NumericVector::create(NA_REAL, NA_REAL, NA_REAL, NA_REAL);
+    if(stats.box.valid()) {
+      bbox[0] = stats.box.bottom_left().lon();
+      bbox[1] = stats.box.bottom_left().lat();
+      bbox[2] = stats.box.top_right().lon();
+      bbox[3] = stats.box.top_right().lat();
+    }
+    bbox.names() = Rcpp::CharacterVector::create("min_lon", "min_lat", "max_lon", "max_lat");
+    
+    // tag keys ordered by decreasing frequency
+    std::vector<std::pair<std::string, uint64_t>> keys(stats.keys.begin(), stats.keys.end());
+    std::sort(keys.begin(), keys.end(), [](const std::pair<std::string, uint64_t>& a, const std::pair<std::string, uint64_t>& b) {
+      return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+    Rcpp::NumericVector key_counts(keys.size());
+    Rcpp::CharacterVector key_names(keys.size());
+    for(size_t i = 0; i < keys.size(); ++i) {
+      key_counts[i] = static_cast<double>(keys[i].second);
+      key_names[i] = keys[i].first;
+    }
+    key_counts.names() = key_names;
+    
+    return Rcpp::List::create(Rcpp::Named("counts") = counts,
+                              Rcpp::Named("min_id") = min_ids,
+                              Rcpp::Named("max_id") = max_ids,
+                              Rcpp::Named("timestamps") = timestamps,
+                              Rcpp::Named("bbox") = bbox,
+                              Rcpp::Named("keys") = key_counts);
+  }
+  
+  // Handlers exporting a way either as way or as area are told which ways the
+  // areas are assembled from (the ways are passed before their areas)
+  template <typename THandler>
+  void setAreaWays(THandler&, areacollector::way_predicate_type) {
+  }
+  
+  void setAreaWays(GeoJSONHandler& handler, areacollector::way_predicate_type area_ways) {
+    handler.setAreaWays(area_ways);
+  }
+  
+  // Applies the handler to the objects of the file, with the areas and the
+  // node locations if requested. The handler must only need the objects
+  // fulfilling its filter. Only the tags with the given keys are decoded
+  // (if no areas are assembled).
+  template <typename THandler>
+  void apply_objects(THandler& handler, bool areas, bool with_locations, const std::string& idx,
+                     osmium::io::tag_keys_type tag_keys = nullptr) {
+    if(areas && mAreaMode == "ways") {
       osmium::area::Assembler::config_type assembler_config;
-      osmium::area::MultipolygonCollector<osmium::area::Assembler> collector(assembler_config);
-      osmium::io::Reader reader1(mFilename);
-      collector.read_relations(reader1);
-      reader1.close();
+      ClosedWayAreaHandler<osmium::area::Assembler> area_handler(assembler_config,
+        [&handler](osmium::memory::Buffer&& area_buffer) {
+          osmium::apply(area_buffer, handler);
+        });
+      setAreaWays(handler, [&area_handler](const osmium::Way& way) {
+        return area_handler.assemblesWay(way);
+      });
+      osmium::io::Reader reader(mFilename);
+      apply_with_location(handler, reader, idx, area_handler);
+      reader.close();
+      setAreaWays(handler, nullptr);
+      mAreaMemory = osmium::relations::CollectorMemoryUsage();
+    } else if(areas) {
+      osmium::area::Assembler::config_type assembler_config;
+      ParallelMultipolygonCollector<osmium::area::Assembler> collector(assembler_config, mAreaMode == "both");
+      if(mIndex != nullptr) {
+        // the first pass only needs the relation blobs
+        IndexedReader reader1(mFilename, mIndex->select(BlockSelection(), osmium::osm_entity_bits::relation, false),
+                              osmium::osm_entity_bits::relation);
+        collector.read_relations(reader1);
+      } else {
+        osmium::io::Reader reader1(mFilename);
+        collector.read_relations(reader1);
+        reader1.close();
+      }
+      if(mSpillAreaMembers) {
+        collector.spill_members_to_disk();
+      }
+      setAreaWays(handler, [&collector](const osmium::Way& way) {
+        return collector.assemblesWay(way);
+      });
       osmium::io::Reader reader2(mFilename);
       apply_with_area(handler, reader2, collector, idx);
       reader2.close();
+      setAreaWays(handler, nullptr);
+      mAreaMemory = collector.memory_usage();
     } else if(with_locations) {
-      osmium::io::Reader reader(mFilename, mEntities);
-      apply_with_location(handler, reader, idx);
+      osmium::io::File input = inputFile(handler.getFilter(), true, tag_keys);
+      if(mIndex != nullptr) {
+        IndexedReader reader = createIndexedReader(mEntities, true, input.decode_options());
+        apply_with_location(handler, reader, idx);
+        reader.close();
+      } else {
+        osmium::io::Reader reader(input, mEntities);
+        apply_with_location(handler, reader, idx);
+        reader.close();
+      }
+    } else if(mIndex != nullptr) {
+      IndexedReader reader = createIndexedReader(filterEntities(handler.getFilter()), false, inputFile(handler.getFilter(), false, tag_keys).decode_options());
+      apply_filtered(handler, reader);
       reader.close();
     } else {
-      osmium::io::Reader reader(mFilename, mEntities);
-      osmium::apply(reader, handler);
+      osmium::io::Reader reader(inputFile(handler.getFilter(), false, tag_keys), filterEntities(handler.getFilter()));
+      apply_filtered(handler, reader);
       reader.close();
     }
   }
   
+  void apply_r(RHandler& handler, bool with_locations = false, std::string idx = "sparse_mem_array") {
+    ProfileSession session(mProfiling, mProfile);
+    handler.resolveProfileStages();
+    handler.clearFilter();
+    apply_objects(handler, handler.hasAreaCallback(), with_locations, idx, handler.decodedTagKeys());
+  }
+  
+  void apply_columns(ColumnFileHandler& handler, std::string idx) {
+    ProfileSession session(mProfiling, mProfile);
+    handler.init();
+    handler.resolveProfileStages();
+    try {
+      apply_objects(handler, handler.exportsAreas(), handler.needsLocations(), idx);
+      handler.close();
+    } catch(std::exception& e) {
+      handler.abort();
+      Rcpp::stop(e.what());
+    }
+  }
+  
+  void apply_geojson(GeoJSONHandler& handler, std::string idx) {
+    ProfileSession session(mProfiling, mProfile);
+    handler.init();
+    handler.resolveProfileStages();
+    try {
+      apply_objects(handler, handler.exportsAreas(), handler.needsLocations(), idx);
+      handler.close();
+    } catch(std::exception& e) {
+      handler.abort();
+      Rcpp::stop(e.what());
+    }
+  }
+  
+  void apply_table(ObjectTable& table) {
+    table.init();
+    apply_selected(table, filterEntities(table.getFilter()));
+    table.clearFilter();
+  }
+  
+  void apply_tag_matrix(TagMatrix& matrix) {
+    osmium::osm_entity_bits::type entities = filterEntities(matrix.getFilter());
+    if(matrix.learnsVocabulary()) {
+      matrix.startCounting();
+      apply_selected(matrix, entities);
+      matrix.learnVocabulary();
+      matrix.clearFilter();
+    }
+    matrix.init();
+    apply_selected(matrix, entities);
+    matrix.finish();
+    matrix.clearFilter();
+  }
+  
   void apply_writer(WriteHandler& handler, bool include_refs) {
+    ProfileSession session(mProfiling, mProfile);
     osmium::io::Reader reader(mFilename, mEntities);
     handler.init();
+    handler.resolveProfileStages();
     if(include_refs) {
       WriteHelper wh(handler); 
+      wh.resolveProfileStages();
       if(mEntities & osmium::osm_entity_bits::relation) {
         osmium::osm_entity_bits::type pre_pass = osmium::osm_entity_bits::nwr;
         if(!wh.requiresAllEntities()) {
@@ -467,6 +1586,52 @@ public:
   
 };
 
+// Writes synthetic files for load tests, the options are the fields of
+// datagenerator::Config
+class Generator {
+public:
+  Generator(Rcpp::List options) {
+    mConfig.nodes = static_cast<uint64_t>(Rcpp::as<double>(options["nodes"]));
+    mConfig.ways = static_cast<uint64_t>(Rcpp::as<double>(options["ways"]));
+    mConfig.relations = static_cast<uint64_t>(Rcpp::as<double>(options["relations"]));
+    mConfig.taggedNodes = Rcpp::as<double>(options["tagged_nodes"]);
+    mConfig.tagsPerObject = Rcpp::as<int>(options["tags_per_object"]);
+    mConfig.keySkew = Rcpp::as<double>(options["key_skew"]);
+    mConfig.valueSkew = Rcpp::as<double>(options["value_skew"]);
+    mConfig.distinctValues = Rcpp::as<int>(options["distinct_values"]);
+    mConfig.ringDepth = Rcpp::as<int>(options["ring_depth"]);
+    mConfig.idSpacing = static_cast<uint64_t>(Rcpp::as<double>(options["id_spacing"]));
+    mConfig.wayNodes = Rcpp::as<int>(options["way_nodes"]);
+    mConfig.seed = static_cast<uint64_t>(Rcpp::as<double>(options["seed"]));
+  }
+  
+  // Number of nodes, ways and relations written
+  Rcpp::NumericVector write(std::string filename, bool overwrite) {
+    std::unique_ptr<DataGenerator> generator;
+    try {
+      generator.reset(new DataGenerator(mConfig));
+    } catch(std::invalid_argument& e) {
+      Rcpp::stop(e.what());
+    }
+    osmium::io::Header header;
+    header.set("generator", "Rosmium");
+    header.add_box(generator->bounds());
+    osmium::io::Writer writer(filename, header, overwrite ? osmium::io::overwrite::allow : osmium::io::overwrite::no);
+    datagenerator::Counts counts = generator->generate([&writer](osmium::memory::Buffer&& buffer) {
+      writer(std::move(buffer));
+    });
+    writer.close();
+    Rcpp::NumericVector ret = Rcpp::NumericVector::create(
+      Rcpp::Named("nodes") = static_cast<double>(counts.nodes),
+      Rcpp::Named("ways") = static_cast<double>(counts.ways),
+      Rcpp::Named("relations") = static_cast<double>(counts.relations));
+    return ret;
+  }
+  
+private:
+  datagenerator::Config mConfig;
+};
+
 class Dummy {
    int x;
    int get_x() {return x;}
@@ -496,9 +1661,43 @@ RCPP_MODULE(Rosmium){
   class_<OSMReader>("Reader")
     .constructor<std::string, unsigned char>()
     .property("file", &OSMReader::getFilename)
+    .property("entities", &OSMReader::getEntities)
+    .property("spill_area_members", &OSMReader::getSpillAreaMembers, &OSMReader::setSpillAreaMembers)
+    .property("area_mode", &OSMReader::getAreaMode, &OSMReader::setAreaMode)
+    .property("profiling", &OSMReader::getProfiling, &OSMReader::setProfiling)
     .method("apply", &OSMReader::apply)
     .method("applyR", &OSMReader::apply_r)
     .method("apply_writer", &OSMReader::apply_writer)
+    .method("applyGeoJSON", &OSMReader::apply_geojson)
+    .method("applyColumns", &OSMReader::apply_columns)
+    .method("applyTable", &OSMReader::apply_table)
+    .method("applyTagMatrix", &OSMReader::apply_tag_matrix)
+    .method("stats", &OSMReader::stats)
+    .method("areaMemoryUsage", &OSMReader::areaMemoryUsage)
+    .method("profile", &OSMReader::profile)
+    .method("useIndex", &OSMReader::use_index)
+    .method("selectBoundingBox", &OSMReader::select_bounding_box)
+    .method("selectIds", &OSMReader::select_ids)
+    .method("clearSelection", &OSMReader::clear_selection)
+  ;
+  
+  class_<BlockIndex>("BlockIndex")
+    .constructor<std::string>()
+    .property("file", &BlockIndex::getFilename)
+    .property("blobs", &BlockIndex::size)
+    .method("build", &BlockIndex::build)
+    .method("save", &BlockIndex::save)
+    .method("load", &BlockIndex::load)
+  ;
+  
+  class_<MembershipIndex>("MembershipIndex")
+    .constructor<std::string>()
+    .property("file", &MembershipIndex::getFilename)
+    .property("size", &MembershipIndex::size)
+    .method("build", &MembershipIndex::build)
+    .method("save", &MembershipIndex::save)
+    .method("load", &MembershipIndex::load)
+    .method("parents", &membership_parents)
   ;
   
   class_<osmium::handler::Handler>("Handler")
@@ -514,24 +1713,79 @@ RCPP_MODULE(Rosmium){
     .constructor<Rcpp::CharacterVector, Rcpp::IntegerVector>()
     .method("registerFunction", &RHandler::registerFunction)
     .method("registerObjectFilter", &RHandler::registerObjectFilter)
+    .method("setTagKeys", &RHandler::setTagKeys)
     .field("max_results", &RHandler::mResultSize)
   ;
   
+  class_<Cursor>("Cursor")
+    .constructor<std::string, unsigned char, Rcpp::CharacterVector, bool>()
+    .method("registerObjectFilter", &Cursor::registerObjectFilter)
+    .method("setTagKeys", &Cursor::setTagKeys)
+    .method("fetch", &Cursor::fetch)
+    .method("close", &Cursor::close)
+    .property("done", &Cursor::isDone)
+  ;
+  
+  class_<ObjectTable>("ObjectTable")
+    .derives<HandlerWithFilter>("FilterHandler")
+    .default_constructor()
+    .property("size", &ObjectTable::size)
+    .method("columns", &ObjectTable::columns)
+    .method("tag", &ObjectTable::tag)
+  ;
+  
+  class_<TagMatrix>("TagMatrix")
+    .derives<HandlerWithFilter>("FilterHandler")
+    .constructor<Rcpp::CharacterVector, bool, double>()
+    .method("result", &TagMatrix::result)
+  ;
+  
   class_<WriteHandler>("WriteHandler")
     .derives<HandlerWithFilter>("FilterHandler")
     .constructor<std::string>()
   ;
   
+  class_<GeoJSONHandler>("GeoJSONHandler")
+    .derives<HandlerWithFilter>("FilterHandler")
+    .constructor<std::string, Rcpp::CharacterVector, unsigned char, bool>()
+    .property("features", &GeoJSONHandler::features)
+    .property("skipped", &GeoJSONHandler::skipped)
+  ;
+  
+  class_<ColumnFileHandler>("ColumnFileHandler")
+    .derives<HandlerWithFilter>("FilterHandler")
+    .constructor<std::string, Rcpp::CharacterVector, unsigned char, bool, bool>()
+    .property("rows", &ColumnFileHandler::rows)
+  ;
+  
+  class_<ColumnFile>("ColumnFile")
+    .constructor<std::string>()
+    .property("file", &ColumnFile::getFilename)
+    .property("rows", &ColumnFile::rows)
+    .method("columns", &ColumnFile::columns)
+    .method("read", &ColumnFile::read)
+  ;
+  
   class_<CountHandler>("CountHandler")
     .derives<osmium::handler::Handler>("Handler")
     .default_constructor()
     .field("nodes",&CountHandler::nodes)
     .field("ways", &CountHandler::ways)
+    .field("relations", &CountHandler::relations)
+  ;
+  
+  class_<Generator>("DataGenerator")
+    .constructor<Rcpp::List>()
+    .method("write", &Generator::write)
   ;
   
   class_<ObjectFilter>("ObjectFilter")
     .constructor<Rcpp::CharacterVector>()  
+    .constructor<Rcpp::NumericVector, unsigned char>()
+    .constructor<ObjectFilter&, ObjectFilter&, std::string>()
   ;
 }
 
-
+extern "C" void R_init_Rosmium(DllInfo* dll) {
+  registerLazyVectorClasses(dll);
+}